@@ -0,0 +1,40 @@
+#ifndef COLOR_MAP_H_
+#define COLOR_MAP_H_
+
+#include <mesh.h>
+#include <vector>
+#include <cstddef>
+
+namespace GeomProc {
+
+    // Table of colors sampled uniformly along a range of hues, used to
+    // turn scalar fields into colors. Values are normalized to [0, 1],
+    // where 0 gets the color of hue_begin and 1 the color of hue_end, and
+    // looked up in the table instead of converting each value from HSV
+    class ColorMap {
+        public:
+            // Default table with hues from blue (0.75) to red (0)
+            static const int DefaultSize = 1024;
+
+            ColorMap(float hue_begin = 0.75f, float hue_end = 0.0f, float saturation = 0.8f, float value = 0.8f, int size = DefaultSize);
+
+            // Color of a normalized value, which is clamped to [0, 1]
+            ColorType Get(float t) const;
+
+            // Map count values to colors in parallel. Values are
+            // normalized by data_min and data_max, which are the range of
+            // the finite values when data_min > data_max. Values outside
+            // the range, including INFINITY for unreachable elements, are
+            // clamped to it, and NaN gets the color of data_min
+            void Map(const float *val, size_t count, ColorType *color, float data_min = 1, float data_max = -1) const;
+            void Map(const std::vector<float> &val, std::vector<ColorType> &color, float data_min = 1, float data_max = -1) const;
+
+            int Size(void) const { return (int) table_.size(); }
+
+        private:
+            std::vector<ColorType> table_;
+    };
+
+} // namespace GeomProc
+
+#endif // COLOR_MAP_H_
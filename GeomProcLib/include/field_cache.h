@@ -0,0 +1,172 @@
+#ifndef FIELD_CACHE_H_
+#define FIELD_CACHE_H_
+
+#include <graph_dist.h>
+#include <model_loading.h>
+#include <string>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <future>
+
+namespace GeomProc {
+
+    // Cache file format
+    // A file starts with a FieldCacheHeader, padded to FieldCacheDataOffset
+    // bytes, followed by the fields in the order of the sources, each with
+    // field_size floats in the byte order of the machine that wrote it
+
+    const char FieldCacheMagic[8] = {'G', 'P', 'F', 'C', 'A', 'C', 'H', 'E'};
+    const unsigned int FieldCacheVersion = 1;
+    const unsigned int FieldCacheByteOrder = 0x01020304;
+    const size_t FieldCacheDataOffset = 64;
+
+    struct FieldCacheHeader {
+        char magic[8];
+        unsigned int version;
+        unsigned int byte_order;
+        unsigned long long key;
+        unsigned int field_type;
+        unsigned int reserved;
+        unsigned long long field_size;
+        unsigned long long field_count;
+    };
+
+    // Fields of a cache file, memory-mapped when the platform supports it
+    class CachedFields {
+        public:
+            CachedFields(void);
+
+            // Open a cache file and check its header. Throws an exception
+            // if the file is not a valid cache file
+            void Open(const char *filename);
+            void Close(void);
+            bool IsOpen(void) const { return header_ != NULL; }
+
+            const FieldCacheHeader &Header(void) const { return *header_; }
+            size_t FieldCount(void) const { return header_->field_count; }
+            size_t FieldSize(void) const { return header_->field_size; }
+            // Field of the source with the given index
+            const float *Field(size_t source_index) const { return data_ + source_index*header_->field_size; }
+
+        private:
+            MappedFile file_;
+            const FieldCacheHeader *header_;
+            const float *data_;
+    };
+
+    // Cache of distance fields in a directory, which is kept across runs.
+    // Fields are identified by a hash of the positions and faces of the
+    // mesh, the sources, and the settings of GraphDist. The total size of
+    // the cache is bounded by evicting the least recently used files,
+    // which are tracked by their modification times
+    class FieldCache {
+        public:
+            FieldCache(void);
+
+            // Use a cache directory, which is created if needed, holding
+            // at most max_bytes of fields
+            void Open(const char *directory, unsigned long long max_bytes = 1ULL << 30);
+
+            // Key of the fields that graph_dist computes
+            static unsigned long long Key(const GraphDist &graph_dist);
+
+            // Open the cached fields of graph_dist. Return false if they
+            // are not in the cache
+            bool Find(const GraphDist &graph_dist, CachedFields &fields);
+            // Open the cached fields of graph_dist, computing them and
+            // adding them to the cache first if needed. The fields are
+            // written to the cache file as they are computed, without
+            // keeping them in memory
+            void ComputeShortestPaths(GraphDist &graph_dist, CachedFields &fields);
+
+            // Remove the least recently used files until the cache holds
+            // at most max_bytes, keeping the file of keep
+            void Evict(unsigned long long keep = 0);
+            // Total size of the cache files
+            unsigned long long Size(void) const;
+
+        private:
+            std::string directory_;
+            unsigned long long max_bytes_;
+
+            std::string Filename(unsigned long long key) const;
+            // Open the cached fields of graph_dist, whose key is given
+            bool Find(const GraphDist &graph_dist, unsigned long long key, CachedFields &fields);
+    };
+
+    // Thread-safe cache in memory of the fields of single sources, keyed
+    // by the version of the mesh, the field type, and the source id. The
+    // total size of the cached fields is bounded by evicting the least
+    // recently used ones. Concurrent requests for a field that is not
+    // cached share a single computation. Fields of earlier versions of a
+    // mesh are never requested again, and are eventually evicted
+    class FieldMemoryCache {
+        public:
+            typedef std::shared_ptr<const GraphDist::DistanceField> FieldPtr;
+
+            FieldMemoryCache(size_t max_bytes = 256 << 20);
+
+            // Get the field of a source of mesh, computing it if needed.
+            // The mesh needs connectivity information, and must not be
+            // modified during the call
+            FieldPtr Get(Mesh &mesh, GraphDist::FieldType field_type, IdType source);
+
+            // Remove all the fields. Computations in progress are not
+            // affected
+            void Clear(void);
+            void SetMaxBytes(size_t max_bytes);
+            // Size of the cached fields, and number of fields
+            size_t Bytes(void);
+            size_t Count(void);
+            // Number of requests that found their field in the cache,
+            // including those that waited for a computation in progress,
+            // and of requests that computed their field
+            size_t Hits(void);
+            size_t Misses(void);
+
+        private:
+            struct Key {
+                unsigned long long version;
+                int field_type;
+                IdType source;
+                bool operator<(const Key &other) const {
+                    if (version != other.version){
+                        return version < other.version;
+                    }
+                    if (field_type != other.field_type){
+                        return field_type < other.field_type;
+                    }
+                    return source < other.source;
+                }
+            };
+            struct Entry {
+                std::shared_future<FieldPtr> field;
+                // Size of the field, 0 while it is computed
+                size_t bytes;
+                // Position in the list of recently used fields
+                std::list<Key>::iterator use;
+            };
+
+            std::mutex mutex_;
+            std::map<Key, Entry> entry_;
+            // Keys from the most to the least recently used
+            std::list<Key> use_;
+            size_t bytes_;
+            size_t max_bytes_;
+            size_t hits_;
+            size_t misses_;
+
+            // Evict the least recently used fields that are not being
+            // computed until the size is within the budget. Needs mutex_
+            void Evict(void);
+
+            // Not copyable
+            FieldMemoryCache(const FieldMemoryCache &);
+            FieldMemoryCache &operator=(const FieldMemoryCache &);
+    };
+
+} // namespace GeomProc
+
+#endif // FIELD_CACHE_H_
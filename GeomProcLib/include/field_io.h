@@ -0,0 +1,162 @@
+#ifndef FIELD_IO_H_
+#define FIELD_IO_H_
+
+#include <graph_dist.h>
+#include <field_storage.h>
+#include <file_stream.h>
+#include <model_loading.h>
+#include <vector>
+#include <string>
+
+namespace GeomProc {
+
+    // Binary field format
+    // A file starts with a FieldFileHeader and the ids of the sources of
+    // the fields, followed by one chunk per field. A chunk is the index of
+    // the source of the field, as an unsigned long long, followed by the
+    // field_size distances of the field. With a 16-bit encoding, the
+    // index is followed by the range of the finite values as two floats,
+    // and then by the encoded distances. Chunks are stored in the order
+    // in which the fields were completed, which is not necessarily the
+    // order of the sources. Values are stored in the byte order of the
+    // machine that wrote the file
+
+    const char FieldFileMagic[8] = {'G', 'P', 'F', 'I', 'E', 'L', 'D', 'S'};
+    const unsigned int FieldFileVersion = 1;
+    const unsigned int FieldFileByteOrder = 0x01020304;
+
+    struct FieldFileHeader {
+        char magic[8];
+        unsigned int version;
+        unsigned int byte_order;
+        // GraphDist::FieldType of the fields
+        unsigned int field_type;
+        // FieldEncoding of the distances
+        unsigned int encoding;
+        unsigned long long field_size;
+        unsigned long long field_count;
+    };
+
+    // Writer of distance fields to a binary field file, which is
+    // compressed when its extension is .gz or .zst. Each field is written
+    // as soon as it is received, so that the fields do not need to be
+    // kept in memory
+    class FieldWriter {
+        public:
+            FieldWriter(void);
+            ~FieldWriter();
+
+            // Open a file for the fields of the sources of graph_dist and
+            // write its header. Fields are stored with encoding
+            void Open(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding = FloatEncoding);
+            // Close the file. Throws an exception if any data could not be
+            // written or if not all the fields were written
+            void Close(void);
+
+            // Write the field of a source, which is encoded if needed
+            void Write(size_t source_index, const float *field, size_t size);
+            void Write(size_t source_index, const CompactField &field);
+            // Get a sink that writes each field it receives to this file
+            FieldSink Sink(void);
+
+            size_t FieldCount(void) const { return written_; }
+
+        private:
+            OutputFile file_;
+            std::string filename_;
+            FieldFileHeader header_;
+            size_t written_;
+            // Temporary storage of fields that are converted
+            CompactField compact_;
+            std::vector<float> decoded_;
+
+            void WriteChunk(size_t source_index, const CompactField &field);
+
+            // Not copyable
+            FieldWriter(const FieldWriter &);
+            FieldWriter &operator=(const FieldWriter &);
+    };
+
+    // Reader of binary field files, which returns one field at a time
+    class FieldReader {
+        public:
+            FieldReader(void);
+
+            // Open a file and read its header
+            void Open(const char *filename);
+            void Close(void);
+
+            // Read the next field of the file, and the index of its source.
+            // Return false when all the fields have been read. Fields of
+            // files with a 16-bit encoding are decoded, or can be read
+            // without decoding as a CompactField. Fields of files of
+            // floats are read as a CompactField with QuantizedEncoding
+            bool ReadField(size_t &source_index, std::vector<float> &field);
+            bool ReadField(size_t &source_index, CompactField &field);
+
+            const FieldFileHeader &Header(void) const { return header_; }
+            // Ids of the sources of the fields
+            const std::vector<IdType> &Sources(void) const { return sources_; }
+
+        private:
+            InputStream stream_;
+            std::string filename_;
+            FieldFileHeader header_;
+            std::vector<IdType> sources_;
+            size_t read_;
+            // Temporary storage of fields that are converted
+            CompactField compact_;
+            std::vector<unsigned short> encoded_;
+            std::vector<float> decoded_;
+
+            // Read the index of the source of the next field
+            size_t ReadIndex(void);
+
+            // Read size bytes or throw an exception
+            void ReadBytes(void *data, size_t size);
+    };
+
+    // Export of the fields of a GraphDist as an S x N array, with one row
+    // per source, of little-endian 32-bit floats (FloatEncoding) or 16-bit
+    // floats (HalfEncoding). The array is written to a .npy file, or as
+    // raw values, and a JSON sidecar file with the name of the file
+    // followed by ".json" describes its shape, type, and sources. The
+    // fields are taken from the storage selected by storage_type
+    void write_fields_npy(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding = FloatEncoding);
+    void write_fields_raw(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding = FloatEncoding);
+
+    // Reader of arrays of fields written by write_fields_npy or
+    // write_fields_raw. The file is memory-mapped when the platform
+    // supports it, and the values are used in place. The shape of raw
+    // files is read from their JSON sidecar file
+    class FieldArrayFile {
+        public:
+            FieldArrayFile(void);
+
+            void Open(const char *filename);
+            void Close(void);
+
+            size_t Rows(void) const { return rows_; }
+            size_t Cols(void) const { return cols_; }
+            // FloatEncoding or HalfEncoding
+            FieldEncoding Encoding(void) const { return encoding_; }
+            // Values of the array, stored row by row in little-endian order
+            const void *Data(void) const { return data_; }
+
+            // Get the field of a row, or a single value
+            void GetField(size_t row, float *field) const;
+            float Get(size_t row, size_t col) const;
+
+        private:
+            MappedFile file_;
+            const char *data_;
+            size_t rows_;
+            size_t cols_;
+            FieldEncoding encoding_;
+            // Whether values need their bytes swapped on this machine
+            bool swap_;
+    };
+
+} // namespace GeomProc
+
+#endif // FIELD_IO_H_
@@ -0,0 +1,126 @@
+#ifndef FIELD_STORAGE_H_
+#define FIELD_STORAGE_H_
+
+#include <vector>
+#include <cstddef>
+
+namespace GeomProc {
+
+    // Encoding of the values of a distance field
+    //  FloatEncoding: 32-bit floats
+    //  HalfEncoding: 16-bit floats, with a relative error of at most
+    //    2^-11 (about 4.9e-4) for values of magnitude at least 2^-14, and
+    //    an absolute error of at most 2^-25 below. Finite values must be
+    //    smaller than 65520 in magnitude
+    //  QuantizedEncoding: 16-bit integers spread evenly over the range
+    //    [min, max] of the finite values of the field, with an absolute
+    //    error of at most (max - min)/131068, about 7.6e-6 of the range,
+    //    plus 2^-22 of the largest magnitude for float rounding
+    // Infinite values are kept by both 16-bit encodings
+    enum FieldEncoding { FloatEncoding, HalfEncoding, QuantizedEncoding };
+
+    // Convert count values between 32-bit and 16-bit floats, rounding to
+    // nearest even
+    void floats_to_halves(const float *in, unsigned short *out, size_t count);
+    void halves_to_floats(const unsigned short *in, float *out, size_t count);
+
+    // Storage of S distance fields of N values each in a single
+    // contiguous buffer, with one row per field. Every row starts at a
+    // multiple of Alignment bytes, so rows are Stride() floats apart,
+    // which can be more than N. The padding at the end of each row is
+    // not part of the fields
+    class DistanceMatrix {
+        public:
+            // Alignment in bytes of the rows
+            static const size_t Alignment = 64;
+
+            DistanceMatrix(void);
+            DistanceMatrix(size_t rows, size_t cols);
+            DistanceMatrix(const DistanceMatrix &other);
+            DistanceMatrix &operator=(const DistanceMatrix &other);
+            ~DistanceMatrix();
+
+            // Change the size of the matrix, which loses its contents, and
+            // set all values to value
+            void Resize(size_t rows, size_t cols, float value = 0.0f);
+            void Clear(void);
+
+            size_t Rows(void) const { return rows_; }
+            size_t Cols(void) const { return cols_; }
+            // Distance in floats between the starts of two rows
+            size_t Stride(void) const { return stride_; }
+            float *Data(void) { return data_; }
+            const float *Data(void) const { return data_; }
+            float *Row(size_t row) { return data_ + row*stride_; }
+            const float *Row(size_t row) const { return data_ + row*stride_; }
+            float &operator()(size_t row, size_t col) { return data_[row*stride_ + col]; }
+            float operator()(size_t row, size_t col) const { return data_[row*stride_ + col]; }
+
+            // Smallest value of a row
+            float Min(size_t row) const;
+            // Column of the smallest value of a row, the first one if
+            // there are several
+            size_t ArgMin(size_t row) const;
+            // Smallest and largest finite values of a row. Return false if
+            // the row has no finite values
+            bool Range(size_t row, float &min, float &max) const;
+            // Map the finite values of each row linearly to [0, 1].
+            // Infinite values, which mark unreachable elements, are kept
+            void Normalize(void);
+            // For each column, get the row with the smallest value, and
+            // optionally that value. With one field per source, this gives
+            // the closest source of each element
+            void ColumnArgMin(std::vector<int> &row, std::vector<float> *value = NULL) const;
+
+        private:
+            float *data_;
+            size_t rows_;
+            size_t cols_;
+            size_t stride_;
+    };
+
+    // A distance field stored with one of the 16-bit encodings, which
+    // halves its memory. The values can be read directly from the
+    // encoded form. Conversions use F16C or SSE2 when available
+    class CompactField {
+        public:
+            CompactField(void);
+
+            // Encode size values of field. Throws an exception if the
+            // values do not fit the encoding
+            void Encode(const float *field, size_t size, FieldEncoding encoding = QuantizedEncoding);
+            // Set the encoded values directly, for example from a file.
+            // min and max are the range of the finite values of the field
+            void Assign(FieldEncoding encoding, float min, float max, const unsigned short *data, size_t size);
+            // Decode the values [begin, end) into field
+            void Decode(float *field, size_t begin, size_t end) const;
+            void Decode(float *field) const { Decode(field, 0, Size()); }
+            // Decode a single value
+            float Get(size_t i) const;
+
+            size_t Size(void) const { return data_.size(); }
+            FieldEncoding Encoding(void) const { return encoding_; }
+            const unsigned short *Data(void) const { return data_.data(); }
+            // Range of the finite values of the field. Return false if it
+            // has no finite values
+            bool Range(float &min, float &max) const;
+            // Largest absolute error of a decoded finite value
+            float ErrorBound(void) const;
+            // Index of the smallest value, the first one if there are
+            // several, found on the encoded values without decoding them
+            size_t ArgMin(void) const;
+
+        private:
+            std::vector<unsigned short> data_;
+            FieldEncoding encoding_;
+            // Range of the finite values, and the quantization step
+            float min_;
+            float max_;
+            float step_;
+
+            void SetRange(float min, float max);
+    };
+
+} // namespace GeomProc
+
+#endif // FIELD_STORAGE_H_
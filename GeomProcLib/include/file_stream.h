@@ -0,0 +1,114 @@
+#ifndef FILE_STREAM_H_
+#define FILE_STREAM_H_
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace GeomProc {
+
+    // Compression of a file. Gzip is available when the library is built
+    // with zlib (GEOMPROC_HAS_ZLIB), and zstd when it is built with zstd
+    // (GEOMPROC_HAS_ZSTD)
+    enum Compression { NoCompression, GzipCompression, ZstdCompression };
+
+    // Get the compression of data from its magic bytes
+    Compression detect_compression(const char *data, size_t size);
+    // Get the compression of a file from its magic bytes
+    Compression file_compression(const char *filename);
+    // Get the compression of a file from its extension, .gz or .zst
+    Compression extension_compression(const std::string &filename);
+    // Get the extension that gives the format of a mesh file, ignoring a
+    // compression extension, so that "mesh.obj.gz" gives "obj"
+    std::string mesh_extension(const std::string &filename);
+
+    // Sequential reader of a file that may be compressed. Compressed
+    // files are detected by their magic bytes and decoded by a separate
+    // thread into a bounded queue of blocks, so that decoding overlaps
+    // with the processing of the blocks already decoded
+    class InputStream {
+        public:
+            InputStream(void);
+            ~InputStream();
+
+            // Open and close the file
+            void Open(const char *filename);
+            void Close(void);
+
+            // Read up to size bytes into data. Return the number of bytes
+            // read, which is less than size only at the end of the file
+            size_t Read(char *data, size_t size);
+
+            bool IsOpen(void) const { return file_ != NULL; }
+            bool Compressed(void) const { return compression_ != NoCompression; }
+
+        private:
+            FILE *file_;
+            std::string filename_;
+            Compression compression_;
+            // Decoded block being read, and the position of its next byte
+            std::vector<char> current_;
+            size_t position_;
+            // Decoded blocks waiting to be read
+            std::deque<std::vector<char> > queue_;
+            // Decoding thread and its state, shared under mutex_
+            std::thread thread_;
+            std::mutex mutex_;
+            std::condition_variable cond_;
+            bool done_;
+            bool stop_;
+            std::exception_ptr error_;
+
+            // Body of the decoding thread
+            void Decode(void);
+            void DecodeGzip(void);
+            void DecodeZstd(void);
+            // Add a decoded block to the queue, waiting while the queue is
+            // full. Return false if the stream was closed
+            bool Push(std::vector<char> &block);
+
+            // Not copyable
+            InputStream(const InputStream &);
+            InputStream &operator=(const InputStream &);
+    };
+
+    // Sequential writer of a file, which is compressed when its extension
+    // is .gz or .zst
+    class OutputFile {
+        public:
+            OutputFile(void);
+            ~OutputFile();
+
+            // Open and close the file. Close throws an exception if any
+            // data could not be written
+            void Open(const char *filename);
+            void Close(void);
+            bool IsOpen(void) const { return file_ != NULL; }
+
+            void Write(const void *data, size_t size);
+
+        private:
+            FILE *file_;
+            std::string filename_;
+            Compression compression_;
+            // State of the compressor and its output buffer
+            void *stream_;
+            std::vector<char> buffer_;
+            bool ok_;
+
+            // Write the compressed bytes in buffer_
+            void WriteBuffer(size_t size);
+
+            // Not copyable
+            OutputFile(const OutputFile &);
+            OutputFile &operator=(const OutputFile &);
+    };
+
+} // namespace GeomProc
+
+#endif // FILE_STREAM_H_
@@ -2,24 +2,123 @@
 #define GRAPH_DIST_H_
 
 #include <mesh.h>
+#include <field_storage.h>
 #include <vector>
+#include <utility>
+#include <functional>
+#include <cmath>
 
 namespace GeomProc {
 
+    // Consumer of distance fields. It receives the index of a source in
+    // GraphDist::sources and its field, with size distances. The field is
+    // only valid during the call
+    typedef std::function<void(size_t source_index, const float *field, size_t size)> FieldSink;
+
+    // Storage used by the shortest path computations, which can be reused
+    // across computations to avoid allocating memory for each of them. The
+    // distance of an element is valid only if its stamp matches the
+    // current generation, so starting a new computation only advances the
+    // generation instead of clearing all the distances. A workspace can
+    // only be used by one computation at a time
+    class GraphDistWorkspace {
+        public:
+            GraphDistWorkspace(void);
+
+            // Distance of an element in the last computation, INFINITY if
+            // the element was not reached
+            float Distance(IdType id) const { return (stamp_[id] == generation_) ? dist_[id] : INFINITY; }
+            // Elements reached by the last computation, in the order in
+            // which they were first reached
+            const std::vector<IdType> &Touched(void) const { return touched_; }
+            // Copy the distances of the last computation into field, which
+            // has one entry per element
+            void GetField(float *field) const;
+
+        private:
+            // Distance of each element, and the generation in which the
+            // distance was set and in which the element was settled
+            std::vector<float> dist_;
+            std::vector<unsigned int> stamp_;
+            std::vector<unsigned int> settled_;
+            unsigned int generation_;
+            std::vector<IdType> touched_;
+            // Storage of the binary heaps used as priority queues
+            std::vector<std::pair<float, VertexPtr> > vertex_heap_;
+            std::vector<std::pair<float, FacePtr> > face_heap_;
+
+            // Start a computation on size elements
+            void Begin(size_t size);
+            // Set the distance of an element
+            void SetDistance(IdType id, float dist){
+                if (stamp_[id] != generation_){
+                    stamp_[id] = generation_;
+                    touched_.push_back(id);
+                }
+                dist_[id] = dist;
+            }
+            // Mark an element as settled. Return false if it already was
+            bool Settle(IdType id){
+                if (settled_[id] == generation_){
+                    return false;
+                }
+                settled_[id] = generation_;
+                return true;
+            }
+
+        friend class GraphDist;
+    };
+
     class GraphDist {
         private:
             Mesh &mesh_;
-            void ComputeVertexShortestPath(int source_index);
-            void ComputeFaceShortestPath(int source_index);
+            // Workspaces of the threads that compute several sources,
+            // kept between calls
+            std::vector<GraphDistWorkspace> workspace_;
+            void ComputeVertexShortestPath(IdType source_id, GraphDistWorkspace &workspace);
+            void ComputeFaceShortestPath(IdType source_id, GraphDistWorkspace &workspace);
+            // Compute the distance field of a source into field, which has
+            // FieldSize() entries
+            void ComputeShortestPath(size_t source_index, float *field, GraphDistWorkspace &workspace);
+            // Get a workspace for each of count threads
+            void PrepareWorkspaces(size_t count);
 
         public:
             enum FieldType { VertexDist, FaceDist } field_type;
             std::vector<IdType> sources;
             typedef std::vector<float> DistanceField;
+            // Storage of the fields, either one vector per field in dist,
+            // a single buffer with one row per field in matrix, or one
+            // 16-bit field per source in compact, with compact_encoding
+            enum StorageType { VectorStorage, MatrixStorage, CompactStorage } storage_type;
+            FieldEncoding compact_encoding;
             std::vector<DistanceField> dist;
+            DistanceMatrix matrix;
+            std::vector<CompactField> compact;
 
-            GraphDist(Mesh &mesh) : mesh_(mesh), field_type(VertexDist) {};
+            GraphDist(Mesh &mesh) : mesh_(mesh), field_type(VertexDist), storage_type(VectorStorage), compact_encoding(QuantizedEncoding) {};
+
+            // Compute the distance fields of all the sources into dist,
+            // matrix, or compact, according to storage_type. The sources
+            // are processed in parallel
             void ComputeShortestPaths(void);
+            // Compute the distance fields of all the sources in parallel
+            // and hand each field to sink as soon as it is complete,
+            // instead of storing it in dist. The sink is called by one
+            // thread at a time, in the order in which the fields are
+            // completed, and only one field per thread is kept in memory
+            void ComputeShortestPaths(const FieldSink &sink);
+
+            // Compute the distances from the vertex or face source_id,
+            // according to field_type, into workspace. This neither uses
+            // nor changes sources and the stored fields, and does not
+            // allocate memory once the workspace has been used for a
+            // computation of the same size
+            void ComputeShortestPath(IdType source_id, GraphDistWorkspace &workspace);
+
+            // Number of distances in a field, one per vertex or face
+            size_t FieldSize(void) const;
+            Mesh &GetMesh(void) const { return mesh_; }
     };
 
 } // namespace GeomProc
@@ -13,6 +13,7 @@ namespace GeomProc {
     class Corner;
     class Face;
     class Mesh;
+    struct MeshGeometryCache;
     typedef class Vertex *VertexPtr;
     typedef class Corner *CornerPtr;
     typedef class Face *FacePtr;
@@ -29,6 +30,40 @@ namespace GeomProc {
     typedef std::vector<FacePtr> FaceInVertexContainer;
     typedef std::set<VertexPtr> VertexResultContainer;
     typedef std::set<FacePtr> FaceResultContainer;
+
+    // Vertex-to-face adjacency in compressed sparse row (CSR) form. The
+    // ids of the faces around the vertex with id v are stored in
+    // face[offset[v]] ... face[offset[v+1]-1], in increasing order
+    struct VertexFaceTable {
+        std::vector<IdType> offset;
+        std::vector<IdType> face;
+    };
+
+    // An edge of the mesh. The vertex ids are stored in increasing order.
+    // face holds the first two faces that contain the edge (-1 if there is
+    // no such face) and face_count the total number of faces, so boundary
+    // edges have face_count == 1
+    struct Edge {
+        IdType vertex[2];
+        IdType face[2];
+        IdType face_count;
+    };
+
+    // The unique edges of the mesh with per-edge attributes. Edges are
+    // sorted by their vertex ids, so the id of an edge only depends on the
+    // topology of the mesh. Edge k of face f, which goes from corner k to
+    // corner (k+1)%3, has id face_edge[3*f+k]. length and cot_weight are
+    // indexed by edge id, where cot_weight is the cotangent Laplacian
+    // weight (cot(alpha) + cot(beta))/2 of the edge. The cotangents of
+    // all the faces of non-manifold edges are added. length and
+    // cot_weight depend on the positions, so GetEdgeTable recomputes them
+    // along with the other derived quantities of the geometry
+    struct EdgeTable {
+        std::vector<Edge> edge;
+        std::vector<IdType> face_edge;
+        std::vector<float> length;
+        std::vector<float> cot_weight;
+    };
  
     // A vertex
     class Vertex {
@@ -41,6 +76,9 @@ namespace GeomProc {
             ColorType color_;
             UVType uv_;
             FaceInVertexContainer face_;
+            // Version and derived quantities of the mesh of the vertex,
+            // which are renewed when its position changes
+            MeshGeometryCache *geometry_cache_;
  
         public:
             // Creation
@@ -93,6 +131,37 @@ namespace GeomProc {
             void RemoveFace(IdType id);
             void RemoveFace(FacePtr face);
 
+            // Neighbor iterator
+            // Visits each vertex in the one-ring once, without allocating
+            // memory. Vertices are visited in the order of the faces around
+            // the vertex and of the corners in each face
+            class NeighborIterator {
+                public:
+                    typedef NeighborIterator self_type;
+                    typedef VertexPtr value_type;
+                    typedef VertexPtr reference;
+                    typedef VertexPtr pointer;
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef int difference_type;
+                    NeighborIterator(void) : vertex_(NULL), face_index_(0), corner_index_(0) { }
+                    NeighborIterator(VertexPtr vertex, IdType face_index);
+                    self_type operator++() { Advance(); return *this; }
+                    self_type operator++(int) { self_type i = *this; Advance(); return i; }
+                    reference operator*() const;
+                    pointer operator->() const { return **this; }
+                    bool operator==(const self_type& rhs) const { return (face_index_ == rhs.face_index_) && (corner_index_ == rhs.corner_index_); }
+                    bool operator!=(const self_type& rhs) const { return !(*this == rhs); }
+                private:
+                    VertexPtr vertex_;
+                    IdType face_index_;
+                    IdType corner_index_;
+                    void Advance(void);
+                    bool IsNewNeighbor(void) const;
+            };
+
+            NeighborIterator NeighborBegin();
+            NeighborIterator NeighborEnd();
+
             // Connectivity functions
             VertexResultContainer GetNeighbors(void);
     };
@@ -223,6 +292,37 @@ namespace GeomProc {
             VertexIterator VertexBegin(); 
             VertexIterator VertexEnd();
  
+            // Neighbor iterator
+            // Visits each face that shares an edge with this face once,
+            // without allocating memory. Faces are visited in the order of
+            // the edges of this face and of the faces around each vertex
+            class NeighborIterator {
+                public:
+                    typedef NeighborIterator self_type;
+                    typedef FacePtr value_type;
+                    typedef FacePtr reference;
+                    typedef FacePtr pointer;
+                    typedef std::forward_iterator_tag iterator_category;
+                    typedef int difference_type;
+                    NeighborIterator(void) : face_(NULL), edge_index_(0), face_index_(0) { }
+                    NeighborIterator(FacePtr face, IdType edge_index);
+                    self_type operator++() { Advance(); return *this; }
+                    self_type operator++(int) { self_type i = *this; Advance(); return i; }
+                    reference operator*() const;
+                    pointer operator->() const { return **this; }
+                    bool operator==(const self_type& rhs) const { return (edge_index_ == rhs.edge_index_) && (face_index_ == rhs.face_index_); }
+                    bool operator!=(const self_type& rhs) const { return !(*this == rhs); }
+                private:
+                    FacePtr face_;
+                    IdType edge_index_;
+                    IdType face_index_;
+                    void Advance(void);
+                    bool IsNewNeighbor(void) const;
+            };
+
+            NeighborIterator NeighborBegin();
+            NeighborIterator NeighborEnd();
+
             // Connectivity functions
             FaceResultContainer GetNeighbors(void);
 
@@ -241,8 +341,14 @@ namespace GeomProc {
             VertexContainer vertex_;
             // List of faces
             FaceContainer face_;
+            // Vertex-to-face table built with the connectivity
+            VertexFaceTable vertex_face_table_;
+            // Table of unique edges
+            EdgeTable edge_table_;
             // Flags
             bool has_connectivity_;
+            bool has_vertex_face_table_;
+            bool has_edge_table_;
             bool has_vertex_normals_;
             bool has_face_normals_;
             // Id of last element added
@@ -250,21 +356,48 @@ namespace GeomProc {
             IdType last_face_id_;
             // Color scheme
             ColorScheme color_scheme_;
+            // Version and quantities derived from the geometry, shared
+            // with the vertices
+            MeshGeometryCache *geometry_cache_;
 
             void DeletePointers(void);
+            void ComputeEdgeGeometry(const std::vector<FacePtr> &faces);
+            void ComputeVertexFaceTable(void);
+            void AssignVertexFacesFromTable(void);
+            void TopologyChanged(void);
+            // Get the vertices and faces in the order of their ids
+            void GetElementArrays(std::vector<VertexPtr> &vertices, std::vector<FacePtr> &faces);
 
         public:
             // Constructor and destructor
             Mesh(void);
             Mesh(const Mesh &mesh);
+            Mesh(Mesh &&mesh);
             ~Mesh();
 
+            // Assignment
+            Mesh &operator=(const Mesh &mesh);
+            Mesh &operator=(Mesh &&mesh);
+            void Swap(Mesh &mesh);
+
             // Remove all elements from the mesh
             void Clear(void);
+
+            // Version of the contents of the mesh. Versions are unique
+            // among all the meshes of the process, and a new version is
+            // assigned whenever the positions or the topology of the mesh
+            // are modified, including through Vertex::SetPosition.
+            // Changes to normals, colors and uvs keep the version.
+            // Modified assigns a new version explicitly
+            unsigned long long Version(void) const;
+            void Modified(void);
      
             // Connectivity-related functions
             void ClearConnectivity(void);
             void ComputeConnectivity(void);
+            const VertexFaceTable &GetVertexFaceTable(void);
+            void ComputeEdgeTable(void);
+            const EdgeTable &GetEdgeTable(void);
 
             // Geometry-related functions
             void NormalizePositions(float target_min = -1.0, float target_max = 1.0);
@@ -273,6 +406,21 @@ namespace GeomProc {
             void ManuallyAssignVertexNormals(void);
             void ManuallyAssignFaceNormals(void);
 
+            // Quantities derived from the positions of the vertices,
+            // indexed by element id. Each one is computed in parallel on
+            // first use and kept until a position or the topology changes,
+            // through Vertex::SetPosition or the functions of the mesh.
+            // They can be requested from several threads at once, but not
+            // while the mesh is being modified
+            // Centroid of each face
+            const std::vector<PositionType> &GetFaceCentroids(void);
+            // Area of each face
+            const std::vector<AreaType> &GetFaceAreas(void);
+            // One third of the area of the faces around each vertex
+            const std::vector<AreaType> &GetVertexAreas(void);
+            // Corners of the axis-aligned bounding box of the vertices
+            void GetBoundingBox(PositionType &min, PositionType &max);
+
             // Attributes manipulation
             void CopyCornerAttributesToVertices(void);
             void CopyCornerNormalsToVertices(void);
@@ -286,23 +434,59 @@ namespace GeomProc {
                 bool write_vertex_colors;
                 bool write_vertex_uvs;
                 bool write_face_uvs;
+                bool write_connectivity;
+                // Write formats that have a binary and a text variant,
+                // such as ply, as text
+                bool ascii;
+                // Number of significant digits of floats in text formats
+                int precision;
                 char *texture_name;
+                // Colors of the vertices indexed by vertex id, such as the
+                // output of ColorMap::Map. When not NULL, they are written
+                // instead of the colors stored in the vertices
+                const ColorType *vertex_colors;
                 WriteOptions(void) {
                     write_vertex_normals = 0;
                     write_face_normals = 0;
                     write_vertex_colors = 0;
                     write_vertex_uvs = 0;
                     write_face_uvs = 0;
+                    write_connectivity = 0;
+                    ascii = 0;
+                    precision = 6;
                     texture_name = NULL;
+                    vertex_colors = NULL;
+                }
+            };
+            struct ReadOptions {
+                // Attributes to read, when the file has them. Skipped
+                // attributes are not parsed
+                bool read_normals;
+                bool read_colors;
+                bool read_uvs;
+                // Coincident vertices of the triangles of stl files are
+                // welded with weld_positions, which merges vertices at a
+                // distance of at most weld_epsilon
+                float weld_epsilon;
+                ReadOptions(void) {
+                    read_normals = 1;
+                    read_colors = 1;
+                    read_uvs = 1;
+                    weld_epsilon = 0.0;
                 }
             };
-            void Read(const char *filename);
-            void ReadObj(const char *filename);
+            void Read(const char *filename, const ReadOptions &options = ReadOptions());
+            void ReadObj(const char *filename, const ReadOptions &options = ReadOptions());
             void ReadOff(const char *filename);
+            void ReadBinary(const char *filename, const ReadOptions &options = ReadOptions());
+            void ReadPly(const char *filename, const ReadOptions &options = ReadOptions());
+            void ReadStl(const char *filename, const ReadOptions &options = ReadOptions());
 
             void Write(const char *filename, const WriteOptions &options = WriteOptions());
             void WriteObj(const char *filename, const WriteOptions &options = WriteOptions());
             void WriteOff(const char *filename, const WriteOptions &options = WriteOptions());
+            void WriteBinary(const char *filename, const WriteOptions &options = WriteOptions());
+            void WritePly(const char *filename, const WriteOptions &options = WriteOptions());
 
             // Elements
             IdType VertexCount(void) const;
@@ -368,7 +552,15 @@ namespace GeomProc {
             void RemoveVertex(VertexPtr vertex);
             FacePtr RemoveFace(IdType id);
             void RemoveFace(FacePtr face);
-            void ReindexIds(void);
+            // Remove and delete many elements at once. Masks are indexed by
+            // element id, and removing a vertex also removes its faces
+            void RemoveVertices(const std::vector<bool> &mask);
+            void RemoveVertices(const std::vector<IdType> &ids);
+            void RemoveFaces(const std::vector<bool> &mask);
+            void RemoveFaces(const std::vector<IdType> &ids);
+            // Assign sequential ids to the elements. If given, the remap
+            // tables receive the new id of each old id (-1 for unused ids)
+            void ReindexIds(std::vector<IdType> *vertex_remap = NULL, std::vector<IdType> *face_remap = NULL);
 
             // Color schemes
             ColorScheme GetColorScheme(void) const;
@@ -0,0 +1,103 @@
+#ifndef MESH_STREAM_H_
+#define MESH_STREAM_H_
+
+#include <mesh.h>
+#include <model_loading.h>
+#include <file_stream.h>
+#include <vector>
+#include <string>
+
+namespace GeomProc {
+
+    // A block of elements read from a mesh file. Faces are split into
+    // triangles, with 3 entries of index per triangle, and refer to
+    // vertices by their index in the whole file, counting from 0
+    struct MeshBlock {
+        // Index in the file of the first vertex and face of the block
+        size_t first_vertex;
+        size_t first_face;
+        std::vector<PositionType> position;
+        // Empty if the file does not have vertex colors
+        std::vector<ColorType> color;
+        std::vector<int> index;
+
+        size_t VertexCount(void) const { return position.size(); }
+        size_t FaceCount(void) const { return index.size()/3; }
+    };
+
+    // Reader of obj, off, and ply files that returns the elements in
+    // blocks of bounded size, in the order of the file. Only a window of
+    // the file and the current block are kept in memory, so that files
+    // larger than the memory can be processed without building a Mesh.
+    // The files may be compressed with gzip or zstd
+    class MeshStreamReader {
+        public:
+            MeshStreamReader(void);
+            ~MeshStreamReader();
+
+            // Open a mesh file. A block is returned once it holds
+            // block_size vertices or block_size faces
+            void Open(const char *filename, size_t block_size = 65536);
+            void Close(void);
+
+            // Read the next block of elements. Return false when all the
+            // elements of the file have been read
+            bool ReadBlock(MeshBlock &block);
+
+            // Number of elements read so far
+            size_t VertexCount(void) const { return vertex_count_; }
+            size_t FaceCount(void) const { return face_count_; }
+
+        private:
+            enum Format { StreamObj, StreamOff, StreamPly };
+
+            InputStream stream_;
+            std::string filename_;
+            Format format_;
+            size_t block_size_;
+            // Window of the file, with the unread text in [begin_, end_)
+            std::vector<char> buffer_;
+            size_t begin_;
+            size_t end_;
+            bool eof_;
+            // Elements read so far
+            size_t vertex_count_;
+            size_t face_count_;
+            // Element counts given in the header of off files, and the
+            // number of polygons read so far
+            size_t off_vertex_count_;
+            size_t off_face_count_;
+            size_t off_faces_read_;
+            // Header of ply files, with the current element and the
+            // number of its records that have been read
+            PlyHeader ply_header_;
+            unsigned int ply_element_;
+            size_t ply_record_;
+            bool ply_swap_;
+            // Temporary storage of face indices
+            std::vector<int> polygon_;
+
+            // Make at least size unread bytes available in the window.
+            // Return false if the file ends before
+            bool Fill(size_t size);
+            // Get the next line, without the line break. Return false at
+            // the end of the file
+            bool NextLine(const char *&line, const char *&line_end);
+            // Get the next value of a ply file
+            double NextPlyValue(PlyType type);
+            // Add a polygon to the block as a fan of triangles
+            void AddPolygon(MeshBlock &block);
+
+            void ReadHeader(void);
+            void ReadObjBlock(MeshBlock &block);
+            void ReadOffBlock(MeshBlock &block);
+            void ReadPlyBlock(MeshBlock &block);
+
+            // Not copyable
+            MeshStreamReader(const MeshStreamReader &);
+            MeshStreamReader &operator=(const MeshStreamReader &);
+    };
+
+} // namespace GeomProc
+
+#endif // MESH_STREAM_H_
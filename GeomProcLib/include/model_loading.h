@@ -1,6 +1,15 @@
 #ifndef MODEL_LOADING_H_
 #define MODEL_LOADING_H_
 
+#include <mesh.h>
+#include <utils.h>
+#include <file_stream.h>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
 namespace GeomProc {
 
 // Auxiliary definitions and functions for model loading
@@ -19,6 +28,295 @@ struct TempQuad {
     int t[4];
 };
 
+// Binary mesh format
+// A file starts with a BinaryMeshHeader, followed by the arrays whose
+// offset in the header is not zero. Each array starts at a multiple of
+// BinaryMeshAlignment bytes and is stored in the byte order of the
+// machine that wrote the file, so that it can be used directly from a
+// memory-mapped file
+
+// Arrays of the binary mesh format, with V vertices and F faces
+enum BinaryMeshArray {
+    BinaryPosition,         // float[3*V]
+    BinaryIndex,            // int[3*F]
+    BinaryVertexNormal,     // float[3*V]
+    BinaryVertexColor,      // float[3*V]
+    BinaryVertexUV,         // float[2*V]
+    BinaryFaceNormal,       // float[3*F]
+    BinaryFaceArea,         // float[F]
+    BinaryCornerNormal,     // float[9*F]
+    BinaryCornerUV,         // float[6*F]
+    BinaryVertexFaceOffset, // int[V+1], offsets of the vertex-to-face table
+    BinaryVertexFace,       // int[vertex_face_count], faces of the table
+    BinaryArrayCount
+};
+
+const char BinaryMeshMagic[8] = {'G', 'E', 'O', 'M', 'P', 'R', 'O', 'C'};
+const unsigned int BinaryMeshVersion = 1;
+const unsigned int BinaryMeshByteOrder = 0x01020304;
+const unsigned int BinaryMeshAlignment = 64;
+
+struct BinaryMeshHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;
+    unsigned int vertex_count;
+    unsigned int face_count;
+    unsigned int vertex_face_count;
+    unsigned int color_scheme;
+    unsigned long long offset[BinaryArrayCount];
+    // Hash of all the header bytes that come before the checksum
+    unsigned long long checksum;
+};
+
+// Size in bytes of an array of the binary format
+size_t binary_mesh_array_size(const BinaryMeshHeader &header, int array);
+
+// A read-only view of the contents of a file. The file is memory-mapped
+// when the platform supports it, and read into memory otherwise.
+// Compressed files are decompressed into memory
+class MappedFile {
+    public:
+        MappedFile(void);
+        ~MappedFile();
+
+        // Open and close the file
+        void Open(const char *filename);
+        void Close(void);
+
+        // Contents of the file
+        const char *Data(void) const { return data_; }
+        size_t Size(void) const { return size_; }
+
+    private:
+        const char *data_;
+        size_t size_;
+        bool mapped_;
+        std::vector<char> buffer_;
+
+        // Not copyable
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+};
+
+// Buffered output of formatted text. Text is collected in memory and
+// written to the file in large blocks, which are compressed if the file
+// has a compression extension. Floats are formatted like %g in
+// printf with the given number of significant digits, which for 6
+// digits is the default format of iostreams
+class OutputBuffer {
+    public:
+        OutputBuffer(int precision = 6);
+        ~OutputBuffer();
+
+        // Attach a file to the buffer and close it. Without a file, the
+        // buffer grows to hold all the text
+        void Open(const char *filename);
+        void Close(void);
+
+        // Append text
+        void Write(const char *str);
+        void Write(const char *str, size_t size);
+        void Write(char c);
+        void WriteInt(long long value);
+        void WriteFloat(float value);
+
+        // Append the text of count items, where format(buffer, i) appends
+        // the text of item i to buffer. Blocks of items are formatted in
+        // parallel into separate buffers, which are then appended in
+        // order, so the text is the same as when formatting in sequence
+        template <typename Func> void WriteParallel(size_t count, Func format, size_t block_size = 16384);
+
+        // Text that has not been written to the file yet
+        const char *Data(void) const { return buffer_.data(); }
+        size_t Size(void) const { return size_; }
+        void Clear(void) { size_ = 0; }
+
+    private:
+        OutputFile file_;
+        std::vector<char> buffer_;
+        size_t size_;
+        int precision_;
+
+        // Make room for size more characters
+        void Reserve(size_t size);
+        // Write the buffered text to the file
+        void Flush(void);
+
+        // Not copyable
+        OutputBuffer(const OutputBuffer &);
+        OutputBuffer &operator=(const OutputBuffer &);
+};
+
+template <typename Func> void OutputBuffer::WriteParallel(size_t count, Func format, size_t block_size){
+
+    int threads = get_num_threads();
+    if ((threads <= 1) || (count <= block_size)){
+        for (size_t i = 0; i < count; i++){
+            format(*this, i);
+        }
+        return;
+    }
+
+    // Format one block per thread at a time, so that the memory used is
+    // bounded by the size of the blocks
+    std::vector<std::unique_ptr<OutputBuffer> > block(threads);
+    for (int t = 0; t < threads; t++){
+        block[t].reset(new OutputBuffer(precision_));
+    }
+    for (size_t first = 0; first < count; first += threads*block_size){
+        parallel_invoke(threads, [&](int t){
+            OutputBuffer &buffer = *block[t];
+            buffer.Clear();
+            size_t begin = std::min(count, first + t*block_size);
+            size_t end = std::min(count, begin + block_size);
+            for (size_t i = begin; i < end; i++){
+                format(buffer, i);
+            }
+        });
+        for (int t = 0; t < threads; t++){
+            Write(block[t]->Data(), block[t]->Size());
+        }
+    }
+}
+
+// Text parsing functions that work in place on a character range
+// Skip spaces and tabs
+inline const char *skip_blanks(const char *p, const char *end){
+    while ((p < end) && ((*p == ' ') || (*p == '\t'))){
+        p++;
+    }
+    return p;
+}
+
+// Skip until the next space, tab, or end of line
+inline const char *skip_token(const char *p, const char *end){
+    while ((p < end) && (*p != ' ') && (*p != '\t') && (*p != '\r') && (*p != '\n')){
+        p++;
+    }
+    return p;
+}
+
+// Parse a number at the beginning of [begin, end). Return a pointer past
+// the number, or throw an exception if no number can be parsed
+const char *parse_float(const char *begin, const char *end, float &value);
+const char *parse_int(const char *begin, const char *end, int &value);
+
+// Optional vertex and corner attributes to be read from a file, as a
+// combination of bits
+enum MeshAttribute { AttributeColor = 1, AttributeNormal = 2, AttributeUV = 4, AllAttributes = 7 };
+
+// Elements read from the text of an obj file
+struct ObjChunk {
+    std::vector<PositionType> position;
+    std::vector<ColorType> color;
+    std::vector<NormalType> normal;
+    std::vector<UVType> uv;
+    std::vector<TempFace> face;
+    // Faces with relative indices, as pairs of face index and a bit mask
+    // of the relative indices (bit k for i[k], 3+k for t[k], 6+k for n[k])
+    std::vector<std::pair<unsigned int, unsigned short> > relative;
+};
+
+// Parse the lines of an obj file in [begin, end) and append the elements
+// to chunk. Face indices are converted to 0-based indices, where relative
+// indices are resolved against the number of elements in chunk. The lines
+// and face fields of attributes not in attributes are skipped
+void parse_obj(const char *begin, const char *end, ObjChunk &chunk, int attributes = AllAttributes);
+
+// Split the obj text in [begin, end) into chunks of whole lines and parse
+// the chunks in parallel. Relative face indices are resolved against the
+// elements of all the preceding chunks, so the indices in every chunk
+// refer to the concatenation of the elements of all chunks
+void parse_obj_chunks(const char *begin, const char *end, std::vector<ObjChunk> &chunk, int attributes = AllAttributes);
+
+// Parse the obj text read from stream in chunks of whole lines, as they
+// are read. The indices in every chunk refer to the concatenation of the
+// elements of all chunks, like in parse_obj_chunks
+void parse_obj_stream(InputStream &stream, std::vector<ObjChunk> &chunk, int attributes = AllAttributes);
+
+// Ply format
+enum PlyFormat { PlyAscii, PlyBinaryLittleEndian, PlyBinaryBigEndian };
+enum PlyType { PlyNone, PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64 };
+
+// A property of a ply element. count_type is PlyNone for scalar
+// properties, and the type of the item count for list properties
+struct PlyProperty {
+    std::string name;
+    PlyType type;
+    PlyType count_type;
+};
+
+// An element of a ply file, such as "vertex" or "face"
+struct PlyElement {
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> property;
+    // Index of the property with the given name, or -1 if not found
+    int FindProperty(const char *name) const;
+    // Size in bytes of a binary record, or 0 if it contains lists
+    size_t RecordSize(void) const;
+};
+
+// Header of a ply file. size is the number of bytes up to the data
+struct PlyHeader {
+    PlyFormat format;
+    std::vector<PlyElement> element;
+    size_t size;
+};
+
+// Size in bytes of a binary value of the given type
+size_t ply_type_size(PlyType type);
+
+// Check if the machine stores values in little-endian order
+bool host_is_little_endian(void);
+
+// Decode a binary value at p, swapping bytes if required
+double ply_binary_value(const char *p, PlyType type, bool swap);
+
+// Scale that maps colors of the given type to [0, 1]. Integer colors are
+// divided by the largest value of the type, and floats are kept as is
+double ply_color_scale(PlyType type);
+
+// Parse the header of a ply file in [begin, end)
+void parse_ply_header(const char *begin, const char *end, PlyHeader &header);
+
+// Elements read from a ply file. Polygons are split into triangles, with
+// 3 entries of index and corner_uv per triangle. Empty vectors mean that
+// the file does not have the attribute
+struct PlyData {
+    std::vector<PositionType> position;
+    std::vector<NormalType> normal;
+    std::vector<ColorType> color;
+    std::vector<UVType> uv;
+    std::vector<int> index;
+    std::vector<UVType> corner_uv;
+};
+
+// Parse a whole ply file in [begin, end). Fixed-size binary vertex
+// records are decoded in parallel. Attributes not in attributes are not
+// stored
+void parse_ply(const char *begin, const char *end, PlyData &data, int attributes = AllAttributes);
+
+// Stl format
+// Triangles of an stl file, with 3 entries of position per triangle
+struct StlData {
+    std::vector<PositionType> position;
+};
+
+// Parse a binary or ascii stl file in [begin, end)
+void parse_stl(const char *begin, const char *end, StlData &data);
+
+// Weld coincident positions. Two positions at a distance of at most
+// epsilon are merged, and so are chains of such positions, so merged
+// positions can be farther apart than epsilon. Positions are only merged
+// when they are equal if epsilon is zero. Positions are sorted into a grid
+// with cells of size epsilon, so that each one is only compared with the
+// positions of the same and of the neighboring cells. unique receives the
+// merged positions in order of first occurrence, and index the entry of
+// unique for each input position
+void weld_positions(const std::vector<PositionType> &position, float epsilon, std::vector<int> &index, std::vector<PositionType> &unique);
+
 } // namespace GeomProc
 
 #endif // MODEL_LOADING_H_
@@ -5,6 +5,9 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <exception>
+#include <algorithm>
 
 namespace GeomProc {
 
@@ -16,7 +19,26 @@ namespace GeomProc {
     // Mapping of values from one range to another
     float map_value(float val, float target_min, float target_max, float data_min, float data_max);
 
+    // Map values in place from [data_min, data_max] to [target_min,
+    // target_max], in parallel. When data_min > data_max, the range is the
+    // one of the finite values, so INFINITY entries such as unreachable
+    // vertices do not affect it. Values outside the range, including
+    // infinite ones, are clamped to it, and NaN values are kept. All
+    // values are mapped to target_min when the range is empty
     void map_values(std::vector<float> &val, float target_min, float target_max, float data_min = 1, float data_max = -1);
+    void map_values(float *val, size_t count, float target_min, float target_max, float data_min = 1, float data_max = -1);
+
+    // Smallest and largest finite values of [val, val + count). Return
+    // false if there are no finite values
+    bool finite_range(const float *val, size_t count, float &min, float &max);
+    // Same as finite_range, with blocks of at least min_block values
+    // processed in parallel
+    bool parallel_finite_range(const float *val, size_t count, float &min, float &max, size_t min_block = 65536);
+
+    // Hashing
+    // 64-bit FNV-1a hash of size bytes of data. A previous hash can be
+    // passed in to hash several blocks of data in sequence
+    unsigned long long hash_bytes(const void *data, size_t size, unsigned long long hash = 14695981039346656037ULL);
 
     // String utility functions
     // Get the extension of a filename
@@ -50,6 +72,110 @@ namespace GeomProc {
         return result;
     }
 
+    // Parallel execution
+    // Get the number of threads used by the parallel functions of the
+    // library
+    int get_num_threads(void);
+    // Set the number of threads used by the parallel functions of the
+    // library. A value <= 0 selects the number of hardware threads
+    void set_num_threads(int num_threads);
+
+    // Run func(i) for every i in [0, count), each call on its own thread.
+    // The first exception thrown by any of the calls is rethrown to the
+    // caller once all threads have finished
+    template <typename Func> void parallel_invoke(int count, Func func){
+
+        if (count <= 0){
+            return;
+        }
+        if (count == 1){
+            func(0);
+            return;
+        }
+
+        std::vector<std::exception_ptr> error(count);
+        std::vector<std::thread> thread;
+        thread.reserve(count-1);
+        for (int i = 1; i < count; i++){
+            thread.push_back(std::thread([&func, &error, i](){
+                try {
+                    func(i);
+                } catch (...){
+                    error[i] = std::current_exception();
+                }
+            }));
+        }
+        try {
+            func(0);
+        } catch (...){
+            error[0] = std::current_exception();
+        }
+        for (unsigned int i = 0; i < thread.size(); i++){
+            thread[i].join();
+        }
+        for (int i = 0; i < count; i++){
+            if (error[i]){
+                std::rethrow_exception(error[i]);
+            }
+        }
+    }
+
+    // Split the range [begin, end) into at most get_num_threads()
+    // contiguous blocks of at least min_block elements and call
+    // func(block_begin, block_end) for each block in parallel
+    template <typename Func> void parallel_for(size_t begin, size_t end, Func func, size_t min_block = 4096){
+
+        if (end <= begin){
+            return;
+        }
+        size_t count = end - begin;
+        size_t blocks = std::min<size_t>(get_num_threads(), (count + min_block - 1)/min_block);
+        if (blocks <= 1){
+            func(begin, end);
+            return;
+        }
+        parallel_invoke((int) blocks, [&](int b){
+            func(begin + (count*b)/blocks, begin + (count*(b+1))/blocks);
+        });
+    }
+
+    // Sort the range [begin, end) using several threads. Blocks of the
+    // range are sorted in parallel and then merged pairwise
+    template <typename Iter, typename Compare> void parallel_sort(Iter begin, Iter end, Compare comp, size_t min_block = 65536){
+
+        size_t count = end - begin;
+        size_t blocks = std::min<size_t>(get_num_threads(), (count + min_block - 1)/min_block);
+        if (blocks <= 1){
+            std::sort(begin, end, comp);
+            return;
+        }
+
+        // Sort each block
+        std::vector<size_t> bound(blocks+1);
+        for (size_t b = 0; b <= blocks; b++){
+            bound[b] = (count*b)/blocks;
+        }
+        parallel_invoke((int) blocks, [&](int b){
+            std::sort(begin + bound[b], begin + bound[b+1], comp);
+        });
+
+        // Merge neighboring blocks until a single block is left
+        while (bound.size() > 2){
+            int pairs = (bound.size()-1)/2;
+            parallel_invoke(pairs, [&](int p){
+                std::inplace_merge(begin + bound[2*p], begin + bound[2*p+1], begin + bound[2*p+2], comp);
+            });
+            std::vector<size_t> merged;
+            for (size_t b = 0; b < bound.size(); b += 2){
+                merged.push_back(bound[b]);
+            }
+            if (merged.back() != count){
+                merged.push_back(count);
+            }
+            bound.swap(merged);
+        }
+    }
+
 } // namespace GeomProc
 
 #endif // UTILS_H_
@@ -0,0 +1,81 @@
+#include <color_map.h>
+#include <utils.h>
+#include <cmath>
+#include <algorithm>
+#include "simd.h"
+
+namespace GeomProc {
+
+
+// Minimum number of values mapped by each thread
+static const size_t ColorMapBlock = 65536;
+
+
+ColorMap::ColorMap(float hue_begin, float hue_end, float saturation, float value, int size){
+
+    size = std::max(size, 2);
+    table_.resize(size);
+    for (int i = 0; i < size; i++){
+        float h = hue_begin + (hue_end - hue_begin)*((float) i/(size - 1));
+        table_[i] = hsv2rgb(glm::vec3(h, saturation, value));
+    }
+}
+
+
+ColorType ColorMap::Get(float t) const {
+
+    // NaN fails both comparisons and is mapped to 0
+    t = (t > 0.0f) ? std::min(t, 1.0f) : 0.0f;
+    return table_[(int) (t*(table_.size() - 1) + 0.5f)];
+}
+
+
+void ColorMap::Map(const float *val, size_t count, ColorType *color, float data_min, float data_max) const {
+
+    // Check if data min and max need to be computed
+    if (data_min > data_max){
+        if (!parallel_finite_range(val, count, data_min, data_max, ColorMapBlock)){
+            data_min = data_max = 0.0f;
+        }
+    }
+
+    // Index of the table entry of a value
+    float last = table_.size() - 1;
+    float scale = (data_max > data_min) ? last/(data_max - data_min) : 0.0f;
+    const ColorType *table = table_.data();
+    parallel_for(0, count, [&](size_t begin, size_t end){
+        size_t i = begin;
+#ifdef __SSE2__
+        // The clamp to [data_min, data_max] maps NaN to data_min
+        __m128 vmin = _mm_set1_ps(data_min);
+        __m128 vmax = _mm_set1_ps(data_max);
+        __m128 vscale = _mm_set1_ps(scale);
+        __m128 half = _mm_set1_ps(0.5f);
+        int index[4];
+        for (; i + 4 <= end; i += 4){
+            __m128 x = clamp(_mm_loadu_ps(val + i), vmin, vmax);
+            x = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, vmin), vscale), half);
+            _mm_storeu_si128((__m128i *) index, _mm_cvttps_epi32(x));
+            color[i] = table[index[0]];
+            color[i+1] = table[index[1]];
+            color[i+2] = table[index[2]];
+            color[i+3] = table[index[3]];
+        }
+#endif
+        for (; i < end; i++){
+            float x = val[i];
+            x = (x > data_min) ? std::min(x, data_max) : data_min;
+            color[i] = table[(int) ((x - data_min)*scale + 0.5f)];
+        }
+    }, ColorMapBlock);
+}
+
+
+void ColorMap::Map(const std::vector<float> &val, std::vector<ColorType> &color, float data_min, float data_max) const {
+
+    color.resize(val.size());
+    Map(val.data(), val.size(), color.data(), data_min, data_max);
+}
+
+
+} // namespace GeomProc
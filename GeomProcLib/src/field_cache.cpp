@@ -0,0 +1,425 @@
+#include <field_cache.h>
+#include <utils.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <exception>
+
+
+namespace GeomProc {
+
+
+CachedFields::CachedFields(void){
+
+    header_ = NULL;
+    data_ = NULL;
+}
+
+
+void CachedFields::Open(const char *filename){
+
+    Close();
+    file_.Open(filename);
+
+    // Check header and size of the file
+    const FieldCacheHeader *header = (const FieldCacheHeader *) file_.Data();
+    bool valid = (file_.Size() >= FieldCacheDataOffset) &&
+                 (memcmp(header->magic, FieldCacheMagic, sizeof(header->magic)) == 0) &&
+                 (header->version == FieldCacheVersion) &&
+                 (header->byte_order == FieldCacheByteOrder) &&
+                 (file_.Size() == FieldCacheDataOffset + header->field_count*header->field_size*sizeof(float));
+    if (!valid){
+        file_.Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". File is not a valid field cache file")));
+    }
+    header_ = header;
+    data_ = (const float *) (file_.Data() + FieldCacheDataOffset);
+}
+
+
+void CachedFields::Close(void){
+
+    file_.Close();
+    header_ = NULL;
+    data_ = NULL;
+}
+
+
+FieldCache::FieldCache(void){
+
+    max_bytes_ = 0;
+}
+
+
+void FieldCache::Open(const char *directory, unsigned long long max_bytes){
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (!std::filesystem::is_directory(directory, ec)){
+        throw(std::ios_base::failure(std::string("Error opening cache directory ")+std::string(directory)));
+    }
+    directory_ = directory;
+    max_bytes_ = max_bytes;
+}
+
+
+unsigned long long FieldCache::Key(const GraphDist &graph_dist){
+
+    Mesh &mesh = graph_dist.GetMesh();
+
+    // Settings and sources
+    unsigned long long hash = hash_bytes(&FieldCacheVersion, sizeof(FieldCacheVersion));
+    unsigned int field_type = graph_dist.field_type;
+    IdType count[2] = { mesh.VertexCount(), mesh.FaceCount() };
+    hash = hash_bytes(&field_type, sizeof(field_type), hash);
+    hash = hash_bytes(count, sizeof(count), hash);
+    hash = hash_bytes(graph_dist.sources.data(), graph_dist.sources.size()*sizeof(IdType), hash);
+
+    // Positions of the vertices
+    Mesh::VertexIterator vit, vend;
+    vit = mesh.VertexBegin();
+    vend = mesh.VertexEnd();
+    for (; vit != vend; vit++){
+        IdType id = (*vit)->GetId();
+        PositionType position = (*vit)->GetPosition();
+        hash = hash_bytes(&id, sizeof(id), hash);
+        hash = hash_bytes(&position[0], 3*sizeof(float), hash);
+    }
+
+    // Vertices of the faces
+    Mesh::FaceIterator fit, fend;
+    fit = mesh.FaceBegin();
+    fend = mesh.FaceEnd();
+    for (; fit != fend; fit++){
+        IdType id[4] = { (*fit)->GetId(), -1, -1, -1 };
+        for (IdType k = 0; (k < (*fit)->VertexCount()) && (k < 3); k++){
+            id[k+1] = (*fit)->GetVertex(k)->GetId();
+        }
+        hash = hash_bytes(id, sizeof(id), hash);
+    }
+    return hash;
+}
+
+
+std::string FieldCache::Filename(unsigned long long key) const {
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.gpf", key);
+    return (std::filesystem::path(directory_) / name).string();
+}
+
+
+bool FieldCache::Find(const GraphDist &graph_dist, CachedFields &fields){
+
+    if (directory_.empty()){
+        throw(std::ios_base::failure(std::string("Error: field cache is not open")));
+    }
+    return Find(graph_dist, Key(graph_dist), fields);
+}
+
+
+bool FieldCache::Find(const GraphDist &graph_dist, unsigned long long key, CachedFields &fields){
+
+    std::string filename = Filename(key);
+    std::error_code ec;
+    if (!std::filesystem::exists(filename, ec)){
+        return false;
+    }
+
+    // Files that are invalid or do not match are removed, so that they
+    // are computed again
+    try {
+        fields.Open(filename.c_str());
+    } catch (std::exception &){
+        std::filesystem::remove(filename, ec);
+        return false;
+    }
+    const FieldCacheHeader &header = fields.Header();
+    if ((header.key != key) || (header.field_type != (unsigned int) graph_dist.field_type) ||
+        (header.field_size != graph_dist.FieldSize()) || (header.field_count != graph_dist.sources.size())){
+        fields.Close();
+        std::filesystem::remove(filename, ec);
+        return false;
+    }
+
+    // Mark the file as recently used
+    std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+}
+
+
+void FieldCache::ComputeShortestPaths(GraphDist &graph_dist, CachedFields &fields){
+
+    if (directory_.empty()){
+        throw(std::ios_base::failure(std::string("Error: field cache is not open")));
+    }
+
+    // The key hashes the whole mesh, so it is only computed once
+    unsigned long long key = Key(graph_dist);
+    if (Find(graph_dist, key, fields)){
+        return;
+    }
+
+    // Write the fields to a temporary file, which is renamed once it is
+    // complete, so that other processes never see a partial file
+    std::string filename = Filename(key);
+    std::string temp_filename = filename + std::string(".") +
+        num_to_str(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                   (size_t) std::chrono::steady_clock::now().time_since_epoch().count()) +
+        std::string(".tmp");
+    std::ofstream f;
+    f.open(temp_filename.c_str(), std::ios::binary);
+    if (f.fail()){
+        throw(std::ios_base::failure(std::string("Error opening file ")+temp_filename));
+    }
+    FieldCacheHeader header;
+    memset(&header, 0, sizeof(FieldCacheHeader));
+    memcpy(header.magic, FieldCacheMagic, sizeof(header.magic));
+    header.version = FieldCacheVersion;
+    header.byte_order = FieldCacheByteOrder;
+    header.key = key;
+    header.field_type = graph_dist.field_type;
+    header.field_size = graph_dist.FieldSize();
+    header.field_count = graph_dist.sources.size();
+    char padding[FieldCacheDataOffset] = {0};
+    memcpy(padding, &header, sizeof(FieldCacheHeader));
+    f.write(padding, FieldCacheDataOffset);
+
+    // Each field is written at its place as soon as it is computed
+    try {
+        graph_dist.ComputeShortestPaths([&](size_t source_index, const float *field, size_t size){
+            f.seekp(FieldCacheDataOffset + source_index*size*sizeof(float));
+            f.write((const char *) field, size*sizeof(float));
+        });
+    } catch (...){
+        f.close();
+        std::error_code ec;
+        std::filesystem::remove(temp_filename, ec);
+        throw;
+    }
+    f.close();
+    std::error_code ec;
+    if (f.fail()){
+        std::filesystem::remove(temp_filename, ec);
+        throw(std::ios_base::failure(std::string("Error writing file ")+temp_filename));
+    }
+    std::filesystem::rename(temp_filename, filename, ec);
+    if (ec){
+        std::filesystem::remove(temp_filename, ec);
+        throw(std::ios_base::failure(std::string("Error writing file ")+filename));
+    }
+
+    Evict(key);
+    fields.Open(filename.c_str());
+}
+
+
+void FieldCache::Evict(unsigned long long keep){
+
+    // Get the cache files with their sizes and times of last use
+    struct CacheFile {
+        std::filesystem::file_time_type time;
+        unsigned long long size;
+        std::filesystem::path path;
+    };
+    std::vector<CacheFile> files;
+    unsigned long long total = 0;
+    std::error_code ec;
+    std::filesystem::directory_iterator dit(directory_, ec), dend;
+    for (; (!ec) && (dit != dend); dit.increment(ec)){
+        if (dit->path().extension() != ".gpf"){
+            continue;
+        }
+        CacheFile file;
+        file.path = dit->path();
+        file.size = std::filesystem::file_size(file.path, ec);
+        file.time = std::filesystem::last_write_time(file.path, ec);
+        if (ec){
+            // The file may have been removed by another process
+            ec.clear();
+            continue;
+        }
+        total += file.size;
+        files.push_back(file);
+    }
+
+    // Remove the least recently used files first
+    std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b){ return a.time < b.time; });
+    std::string keep_filename = Filename(keep);
+    for (size_t i = 0; (i < files.size()) && (total > max_bytes_); i++){
+        if (files[i].path.string() == keep_filename){
+            continue;
+        }
+        if (std::filesystem::remove(files[i].path, ec)){
+            total -= files[i].size;
+        }
+    }
+}
+
+
+unsigned long long FieldCache::Size(void) const {
+
+    unsigned long long total = 0;
+    std::error_code ec;
+    std::filesystem::directory_iterator dit(directory_, ec), dend;
+    for (; (!ec) && (dit != dend); dit.increment(ec)){
+        if (dit->path().extension() == ".gpf"){
+            total += std::filesystem::file_size(dit->path(), ec);
+        }
+    }
+    return total;
+}
+
+
+FieldMemoryCache::FieldMemoryCache(size_t max_bytes){
+
+    bytes_ = 0;
+    max_bytes_ = max_bytes;
+    hits_ = 0;
+    misses_ = 0;
+}
+
+
+FieldMemoryCache::FieldPtr FieldMemoryCache::Get(Mesh &mesh, GraphDist::FieldType field_type, IdType source){
+
+    Key key;
+    key.version = mesh.Version();
+    key.field_type = field_type;
+    key.source = source;
+
+    // Return the cached field, or wait for the thread that computes it
+    std::promise<FieldPtr> promise;
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::map<Key, Entry>::iterator it = entry_.find(key);
+    if (it != entry_.end()){
+        use_.splice(use_.begin(), use_, it->second.use);
+        hits_++;
+        std::shared_future<FieldPtr> field = it->second.field;
+        lock.unlock();
+        return field.get();
+    }
+
+    // Add an entry for the field, which other threads wait on
+    Entry entry;
+    entry.field = promise.get_future().share();
+    entry.bytes = 0;
+    use_.push_front(key);
+    entry.use = use_.begin();
+    entry_[key] = entry;
+    misses_++;
+    lock.unlock();
+
+    // Compute the field. Each thread keeps a workspace, so that repeated
+    // computations do not allocate memory
+    static thread_local GraphDistWorkspace workspace;
+    FieldPtr result;
+    try {
+        GraphDist graph_dist(mesh);
+        graph_dist.field_type = field_type;
+        graph_dist.ComputeShortestPath(source, workspace);
+        std::shared_ptr<GraphDist::DistanceField> field(new GraphDist::DistanceField(graph_dist.FieldSize()));
+        workspace.GetField(field->data());
+        result = field;
+    } catch (...){
+        // Remove the entry, so that later requests try again, and pass
+        // the error to the threads that wait
+        lock.lock();
+        it = entry_.find(key);
+        if ((it != entry_.end()) && (it->second.bytes == 0)){
+            use_.erase(it->second.use);
+            entry_.erase(it);
+        }
+        lock.unlock();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    promise.set_value(result);
+
+    // Account for the size of the field
+    lock.lock();
+    it = entry_.find(key);
+    if ((it != entry_.end()) && (it->second.bytes == 0)){
+        it->second.bytes = result->size()*sizeof(float) + sizeof(GraphDist::DistanceField);
+        bytes_ += it->second.bytes;
+        Evict();
+    }
+    return result;
+}
+
+
+void FieldMemoryCache::Evict(void){
+
+    std::list<Key>::iterator it = use_.end();
+    while ((bytes_ > max_bytes_) && (it != use_.begin())){
+        it--;
+        std::map<Key, Entry>::iterator eit = entry_.find(*it);
+        if (eit->second.bytes == 0){
+            continue;
+        }
+        bytes_ -= eit->second.bytes;
+        entry_.erase(eit);
+        it = use_.erase(it);
+    }
+}
+
+
+void FieldMemoryCache::Clear(void){
+
+    // Entries of fields being computed are kept, so that the computing
+    // threads can find them
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::list<Key>::iterator it = use_.begin();
+    while (it != use_.end()){
+        std::map<Key, Entry>::iterator eit = entry_.find(*it);
+        if (eit->second.bytes == 0){
+            it++;
+            continue;
+        }
+        bytes_ -= eit->second.bytes;
+        entry_.erase(eit);
+        it = use_.erase(it);
+    }
+}
+
+
+void FieldMemoryCache::SetMaxBytes(size_t max_bytes){
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    Evict();
+}
+
+
+size_t FieldMemoryCache::Bytes(void){
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+
+size_t FieldMemoryCache::Count(void){
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entry_.size();
+}
+
+
+size_t FieldMemoryCache::Hits(void){
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+
+size_t FieldMemoryCache::Misses(void){
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+
+} // namespace GeomProc
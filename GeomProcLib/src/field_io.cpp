@@ -0,0 +1,611 @@
+#include <field_io.h>
+#include <utils.h>
+#include <cstring>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+namespace GeomProc {
+
+
+FieldWriter::FieldWriter(void){
+
+    memset(&header_, 0, sizeof(FieldFileHeader));
+    written_ = 0;
+}
+
+
+FieldWriter::~FieldWriter(){
+
+    // Errors can only be reported by calling Close
+    try {
+        Close();
+    } catch (...){
+    }
+}
+
+
+void FieldWriter::Open(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding){
+
+    if ((encoding != FloatEncoding) && (encoding != HalfEncoding) && (encoding != QuantizedEncoding)){
+        throw(std::ios_base::failure(std::string("Error: invalid encoding of field file")));
+    }
+
+    // Open file, which throws an exception on errors
+    file_.Open(filename);
+    filename_ = filename;
+    written_ = 0;
+
+    // Write header and the ids of the sources
+    memset(&header_, 0, sizeof(FieldFileHeader));
+    memcpy(header_.magic, FieldFileMagic, sizeof(header_.magic));
+    header_.version = FieldFileVersion;
+    header_.byte_order = FieldFileByteOrder;
+    header_.field_type = graph_dist.field_type;
+    header_.encoding = encoding;
+    header_.field_size = graph_dist.FieldSize();
+    header_.field_count = graph_dist.sources.size();
+    file_.Write(&header_, sizeof(FieldFileHeader));
+    file_.Write(graph_dist.sources.data(), graph_dist.sources.size()*sizeof(IdType));
+}
+
+
+void FieldWriter::Close(void){
+
+    if (!file_.IsOpen()){
+        return;
+    }
+    file_.Close();
+    if (written_ != header_.field_count){
+        throw(std::ios_base::failure(std::string("Error: only ")+num_to_str(written_)+std::string(" of ")+num_to_str(header_.field_count)+std::string(" fields were written to ")+filename_));
+    }
+}
+
+
+void FieldWriter::Write(size_t source_index, const float *field, size_t size){
+
+    if (!file_.IsOpen()){
+        throw(std::ios_base::failure(std::string("Error: field file is not open")));
+    }
+    if ((size != header_.field_size) || (source_index >= header_.field_count)){
+        throw(std::ios_base::failure(std::string("Error: field does not match the header of ")+filename_));
+    }
+    if (header_.encoding != FloatEncoding){
+        compact_.Encode(field, size, (FieldEncoding) header_.encoding);
+        WriteChunk(source_index, compact_);
+        return;
+    }
+    unsigned long long index = source_index;
+    file_.Write(&index, sizeof(index));
+    file_.Write(field, size*sizeof(float));
+    written_++;
+}
+
+
+void FieldWriter::Write(size_t source_index, const CompactField &field){
+
+    if (field.Encoding() == header_.encoding){
+        if (!file_.IsOpen()){
+            throw(std::ios_base::failure(std::string("Error: field file is not open")));
+        }
+        if ((field.Size() != header_.field_size) || (source_index >= header_.field_count)){
+            throw(std::ios_base::failure(std::string("Error: field does not match the header of ")+filename_));
+        }
+        WriteChunk(source_index, field);
+        return;
+    }
+    // Convert fields with a different encoding
+    decoded_.resize(field.Size());
+    field.Decode(decoded_.data());
+    Write(source_index, decoded_.data(), decoded_.size());
+}
+
+
+void FieldWriter::WriteChunk(size_t source_index, const CompactField &field){
+
+    unsigned long long index = source_index;
+    float range[2];
+    field.Range(range[0], range[1]);
+    file_.Write(&index, sizeof(index));
+    file_.Write(range, sizeof(range));
+    file_.Write(field.Data(), field.Size()*sizeof(unsigned short));
+    written_++;
+}
+
+
+FieldSink FieldWriter::Sink(void){
+
+    return [this](size_t source_index, const float *field, size_t size){
+        Write(source_index, field, size);
+    };
+}
+
+
+FieldReader::FieldReader(void){
+
+    memset(&header_, 0, sizeof(FieldFileHeader));
+    read_ = 0;
+}
+
+
+void FieldReader::Open(const char *filename){
+
+    // Open file, which throws an exception on errors
+    stream_.Open(filename);
+    filename_ = filename;
+    read_ = 0;
+
+    // Read and check header
+    ReadBytes(&header_, sizeof(FieldFileHeader));
+    if (memcmp(header_.magic, FieldFileMagic, sizeof(header_.magic)) != 0){
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". File is not a field file")));
+    }
+    if (header_.version != FieldFileVersion){
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". Unsupported version")));
+    }
+    if (header_.byte_order != FieldFileByteOrder){
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". File was written with a different byte order")));
+    }
+    if ((header_.encoding != FloatEncoding) && (header_.encoding != HalfEncoding) && (header_.encoding != QuantizedEncoding)){
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". Unsupported encoding")));
+    }
+
+    // Read the ids of the sources
+    sources_.resize(header_.field_count);
+    ReadBytes(sources_.data(), sources_.size()*sizeof(IdType));
+}
+
+
+void FieldReader::Close(void){
+
+    stream_.Close();
+    sources_.clear();
+}
+
+
+bool FieldReader::ReadField(size_t &source_index, std::vector<float> &field){
+
+    if ((!stream_.IsOpen()) || (read_ == header_.field_count)){
+        return false;
+    }
+    if (header_.encoding != FloatEncoding){
+        ReadField(source_index, compact_);
+        field.resize(compact_.Size());
+        compact_.Decode(field.data());
+        return true;
+    }
+    source_index = ReadIndex();
+    field.resize(header_.field_size);
+    ReadBytes(field.data(), field.size()*sizeof(float));
+    read_++;
+    return true;
+}
+
+
+bool FieldReader::ReadField(size_t &source_index, CompactField &field){
+
+    if ((!stream_.IsOpen()) || (read_ == header_.field_count)){
+        return false;
+    }
+    if (header_.encoding == FloatEncoding){
+        ReadField(source_index, decoded_);
+        field.Encode(decoded_.data(), decoded_.size(), QuantizedEncoding);
+        return true;
+    }
+    source_index = ReadIndex();
+    float range[2];
+    ReadBytes(range, sizeof(range));
+    encoded_.resize(header_.field_size);
+    ReadBytes(encoded_.data(), encoded_.size()*sizeof(unsigned short));
+    field.Assign((FieldEncoding) header_.encoding, range[0], range[1], encoded_.data(), encoded_.size());
+    read_++;
+    return true;
+}
+
+
+size_t FieldReader::ReadIndex(void){
+
+    unsigned long long index;
+    ReadBytes(&index, sizeof(index));
+    if (index >= header_.field_count){
+        throw(std::ios_base::failure(std::string("Error reading file ")+filename_+std::string(". Invalid source index")));
+    }
+    return index;
+}
+
+
+void FieldReader::ReadBytes(void *data, size_t size){
+
+    if (stream_.Read((char *) data, size) != size){
+        throw(std::ios_base::failure(std::string("Error reading file ")+filename_+std::string(". File too short")));
+    }
+}
+
+
+// Size of the blocks of converted values written at once by the export
+static const size_t FieldExportBlockSize = 1 << 24;
+
+
+// Reverse the bytes of each of count values of size bytes
+static void swap_value_bytes(char *data, size_t size, size_t count){
+
+    for (size_t i = 0; i < count; i++){
+        std::reverse(data + i*size, data + (i+1)*size);
+    }
+}
+
+
+// Number of fields held by the storage of graph_dist, which has to
+// match the number of sources
+static size_t stored_field_count(const GraphDist &graph_dist){
+
+    size_t count;
+    if (graph_dist.storage_type == GraphDist::MatrixStorage){
+        count = graph_dist.matrix.Rows();
+    } else if (graph_dist.storage_type == GraphDist::CompactStorage){
+        count = graph_dist.compact.size();
+    } else {
+        count = graph_dist.dist.size();
+    }
+    if (count != graph_dist.sources.size()){
+        throw(std::ios_base::failure(std::string("Error: the fields of all the sources need to be computed before exporting them")));
+    }
+    return count;
+}
+
+
+// Write the fields of graph_dist as an array of little-endian values.
+// Contiguous float data is written directly, and other rows are
+// converted into blocks that are each written at once
+static void write_field_array(OutputFile &f, const GraphDist &graph_dist, FieldEncoding encoding){
+
+    if ((encoding != FloatEncoding) && (encoding != HalfEncoding)){
+        throw(std::ios_base::failure(std::string("Error: fields can only be exported as float or half values")));
+    }
+    size_t rows = stored_field_count(graph_dist);
+    size_t cols = graph_dist.FieldSize();
+    size_t value_size = (encoding == FloatEncoding) ? sizeof(float) : sizeof(unsigned short);
+    bool swap = !host_is_little_endian();
+
+    // The stored fields need to cover the current elements of the mesh
+    const DistanceMatrix &matrix = graph_dist.matrix;
+    if ((graph_dist.storage_type == GraphDist::MatrixStorage) && (matrix.Cols() != cols)){
+        throw(std::ios_base::failure(std::string("Error: field does not match the mesh")));
+    }
+
+    // A matrix without padding is a single block
+    if ((encoding == FloatEncoding) && (!swap) && (graph_dist.storage_type == GraphDist::MatrixStorage) && (matrix.Stride() == cols)){
+        f.Write(matrix.Data(), rows*cols*sizeof(float));
+        return;
+    }
+
+    std::vector<char> block;
+    std::vector<float> decoded;
+    for (size_t i = 0; i < rows; i++){
+        const float *row = NULL;
+        if (graph_dist.storage_type == GraphDist::MatrixStorage){
+            row = matrix.Row(i);
+        } else if (graph_dist.storage_type == GraphDist::VectorStorage){
+            if (graph_dist.dist[i].size() != cols){
+                throw(std::ios_base::failure(std::string("Error: field does not match the mesh")));
+            }
+            row = graph_dist.dist[i].data();
+        } else if (graph_dist.compact[i].Size() != cols){
+            throw(std::ios_base::failure(std::string("Error: field does not match the mesh")));
+        }
+
+        // Rows of floats that need no conversion are written directly
+        if ((row != NULL) && (encoding == FloatEncoding) && (!swap)){
+            f.Write(row, cols*sizeof(float));
+            continue;
+        }
+
+        // Other rows are converted into the block
+        size_t pos = block.size();
+        block.resize(pos + cols*value_size);
+        char *out = block.data() + pos;
+        if (row == NULL){
+            const CompactField &field = graph_dist.compact[i];
+            if ((encoding == HalfEncoding) && (field.Encoding() == HalfEncoding)){
+                memcpy(out, field.Data(), cols*sizeof(unsigned short));
+            } else {
+                decoded.resize(cols);
+                field.Decode(decoded.data());
+                row = decoded.data();
+            }
+        }
+        if (row != NULL){
+            if (encoding == FloatEncoding){
+                memcpy(out, row, cols*sizeof(float));
+            } else {
+                floats_to_halves(row, (unsigned short *) out, cols);
+            }
+        }
+        if (swap){
+            swap_value_bytes(out, value_size, cols);
+        }
+        if (block.size() >= FieldExportBlockSize){
+            f.Write(block.data(), block.size());
+            block.clear();
+        }
+    }
+    f.Write(block.data(), block.size());
+}
+
+
+// Write the JSON sidecar file of an exported array
+static void write_field_sidecar(const char *filename, const char *format, const GraphDist &graph_dist, FieldEncoding encoding){
+
+    std::string sidecar_filename = std::string(filename) + std::string(".json");
+    std::ofstream f;
+    f.open(sidecar_filename.c_str());
+    if (f.fail()){
+        throw(std::ios_base::failure(std::string("Error opening file ")+sidecar_filename));
+    }
+    f << "{" << std::endl;
+    f << "    \"format\": \"" << format << "\"," << std::endl;
+    f << "    \"dtype\": \"" << ((encoding == FloatEncoding) ? "float32" : "float16") << "\"," << std::endl;
+    f << "    \"byte_order\": \"little\"," << std::endl;
+    f << "    \"shape\": [" << graph_dist.sources.size() << ", " << graph_dist.FieldSize() << "]," << std::endl;
+    f << "    \"field_type\": \"" << ((graph_dist.field_type == GraphDist::FaceDist) ? "face" : "vertex") << "\"," << std::endl;
+    f << "    \"sources\": [";
+    for (size_t i = 0; i < graph_dist.sources.size(); i++){
+        f << ((i > 0) ? ", " : "") << graph_dist.sources[i];
+    }
+    f << "]" << std::endl;
+    f << "}" << std::endl;
+    f.close();
+    if (f.fail()){
+        throw(std::ios_base::failure(std::string("Error writing file ")+sidecar_filename));
+    }
+}
+
+
+void write_fields_npy(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding){
+
+    size_t rows = stored_field_count(graph_dist);
+
+    // Header of version 1.0 of the format, padded so that the data starts
+    // at a multiple of 64 bytes
+    std::ostringstream dict;
+    dict << "{'descr': '" << ((encoding == FloatEncoding) ? "<f4" : "<f2") << "', 'fortran_order': False, 'shape': (" << rows << ", " << graph_dist.FieldSize() << "), }";
+    std::string header = dict.str();
+    size_t total = ((10 + header.size() + 1 + 63)/64)*64;
+    header.append(total - 10 - header.size() - 1, ' ');
+    header += '\n';
+    unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, 0, 0};
+    preamble[8] = header.size() & 0xff;
+    preamble[9] = (header.size() >> 8) & 0xff;
+
+    // Open file, which throws an exception on errors
+    OutputFile f;
+    f.Open(filename);
+    f.Write(preamble, sizeof(preamble));
+    f.Write(header.data(), header.size());
+    write_field_array(f, graph_dist, encoding);
+    f.Close();
+
+    write_field_sidecar(filename, "npy", graph_dist, encoding);
+}
+
+
+void write_fields_raw(const char *filename, const GraphDist &graph_dist, FieldEncoding encoding){
+
+    // Open file, which throws an exception on errors
+    OutputFile f;
+    f.Open(filename);
+    write_field_array(f, graph_dist, encoding);
+    f.Close();
+
+    write_field_sidecar(filename, "raw", graph_dist, encoding);
+}
+
+
+// Find the value of a key in the header of a npy file or in a JSON file,
+// and return the position after its colon, or npos if it is not found
+static size_t find_field_value(const std::string &text, const char *key){
+
+    size_t pos = text.find(key);
+    if (pos == std::string::npos){
+        return pos;
+    }
+    pos = text.find(':', pos);
+    return (pos == std::string::npos) ? pos : pos + 1;
+}
+
+
+// Get the quoted string value of a key, or an empty string
+static std::string field_string_value(const std::string &text, const char *key){
+
+    size_t pos = find_field_value(text, key);
+    if (pos == std::string::npos){
+        return std::string();
+    }
+    size_t begin = text.find_first_of("'\"", pos);
+    if (begin == std::string::npos){
+        return std::string();
+    }
+    size_t end = text.find(text[begin], begin + 1);
+    if (end == std::string::npos){
+        return std::string();
+    }
+    return text.substr(begin + 1, end - begin - 1);
+}
+
+
+// Get the integers of a tuple or list value of a key
+static std::vector<size_t> field_shape_value(const std::string &text, const char *key){
+
+    std::vector<size_t> shape;
+    size_t pos = find_field_value(text, key);
+    if (pos == std::string::npos){
+        return shape;
+    }
+    size_t begin = text.find_first_of("([", pos);
+    size_t end = text.find_first_of(")]", pos);
+    if ((begin == std::string::npos) || (end == std::string::npos) || (end < begin)){
+        return shape;
+    }
+    std::vector<std::string> item = string_split(text.substr(begin + 1, end - begin - 1), ", ");
+    for (size_t i = 0; i < item.size(); i++){
+        if (!item[i].empty()){
+            shape.push_back(strtoull(item[i].c_str(), NULL, 10));
+        }
+    }
+    return shape;
+}
+
+
+FieldArrayFile::FieldArrayFile(void){
+
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+    encoding_ = FloatEncoding;
+    swap_ = false;
+}
+
+
+void FieldArrayFile::Open(const char *filename){
+
+    Close();
+    file_.Open(filename);
+    std::string fn = std::string(filename);
+
+    // Get the description of the array from the header of npy files, or
+    // from the sidecar file of raw files
+    std::string description;
+    size_t offset = 0;
+    std::string ext = mesh_extension(fn);
+    if ((ext == std::string("npy")) || (ext == std::string("NPY"))){
+        const unsigned char *p = (const unsigned char *) file_.Data();
+        if ((file_.Size() < 10) || (memcmp(p, "\x93NUMPY", 6) != 0)){
+            Close();
+            throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". File is not a npy file")));
+        }
+        size_t length;
+        if (p[6] == 1){
+            length = p[8] | (p[9] << 8);
+            offset = 10;
+        } else {
+            length = p[8] | (p[9] << 8) | (p[10] << 16) | ((size_t) p[11] << 24);
+            offset = 12;
+        }
+        if (offset + length > file_.Size()){
+            Close();
+            throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". File too short")));
+        }
+        description = std::string(file_.Data() + offset, length);
+        offset += length;
+        size_t order = find_field_value(description, "'fortran_order'");
+        if ((order != std::string::npos) && (description.compare(description.find_first_not_of(' ', order), 4, "True") == 0)){
+            Close();
+            throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". Arrays in Fortran order are not supported")));
+        }
+    } else {
+        std::string sidecar_filename = fn + std::string(".json");
+        std::ifstream f;
+        f.open(sidecar_filename.c_str());
+        if (f.fail()){
+            Close();
+            throw(std::ios_base::failure(std::string("Error opening file ")+sidecar_filename));
+        }
+        std::stringstream ss;
+        ss << f.rdbuf();
+        description = ss.str();
+    }
+
+    // Type and shape of the values
+    std::string dtype = field_string_value(description, "descr");
+    if (dtype.empty()){
+        dtype = field_string_value(description, "\"dtype\"");
+        if (field_string_value(description, "\"byte_order\"") != std::string("little")){
+            dtype.clear();
+        }
+    }
+    if ((dtype == std::string("<f4")) || (dtype == std::string("float32"))){
+        encoding_ = FloatEncoding;
+    } else if ((dtype == std::string("<f2")) || (dtype == std::string("float16"))){
+        encoding_ = HalfEncoding;
+    } else {
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". Unsupported value type")));
+    }
+    std::vector<size_t> shape = field_shape_value(description, "shape");
+    if (shape.size() == 1){
+        rows_ = 1;
+        cols_ = shape[0];
+    } else if (shape.size() == 2){
+        rows_ = shape[0];
+        cols_ = shape[1];
+    } else {
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". Unsupported array shape")));
+    }
+    size_t value_size = (encoding_ == FloatEncoding) ? sizeof(float) : sizeof(unsigned short);
+    if (offset + rows_*cols_*value_size > file_.Size()){
+        Close();
+        throw(std::ios_base::failure(std::string("Error opening file ")+fn+std::string(". File too short")));
+    }
+    data_ = file_.Data() + offset;
+    swap_ = !host_is_little_endian();
+}
+
+
+void FieldArrayFile::Close(void){
+
+    file_.Close();
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+}
+
+
+void FieldArrayFile::GetField(size_t row, float *field) const {
+
+    if (encoding_ == FloatEncoding){
+        memcpy(field, data_ + row*cols_*sizeof(float), cols_*sizeof(float));
+        if (swap_){
+            swap_value_bytes((char *) field, sizeof(float), cols_);
+        }
+        return;
+    }
+    const unsigned short *in = (const unsigned short *) (data_ + row*cols_*sizeof(unsigned short));
+    if (swap_){
+        std::vector<unsigned short> swapped(in, in + cols_);
+        swap_value_bytes((char *) swapped.data(), sizeof(unsigned short), cols_);
+        halves_to_floats(swapped.data(), field, cols_);
+    } else {
+        halves_to_floats(in, field, cols_);
+    }
+}
+
+
+float FieldArrayFile::Get(size_t row, size_t col) const {
+
+    float value;
+    if (encoding_ == FloatEncoding){
+        memcpy(&value, data_ + (row*cols_ + col)*sizeof(float), sizeof(float));
+        if (swap_){
+            swap_value_bytes((char *) &value, sizeof(float), 1);
+        }
+        return value;
+    }
+    unsigned short h;
+    memcpy(&h, data_ + (row*cols_ + col)*sizeof(unsigned short), sizeof(h));
+    if (swap_){
+        swap_value_bytes((char *) &h, sizeof(h), 1);
+    }
+    halves_to_floats(&h, &value, 1);
+    return value;
+}
+
+
+} // namespace GeomProc
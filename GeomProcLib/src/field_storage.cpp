@@ -0,0 +1,593 @@
+#include <field_storage.h>
+#include <utils.h>
+#include "simd.h"
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <climits>
+#include <exception>
+#include <string>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#if defined(__SSE2__) || defined(__F16C__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#include <immintrin.h>
+#endif
+
+
+namespace GeomProc {
+
+
+// Allocate size bytes aligned to alignment, which needs to be a power of
+// two. The size is rounded up to a multiple of the alignment, as required
+// by aligned_alloc. Blocks are released with aligned_free
+static void *aligned_malloc(size_t alignment, size_t size){
+
+    size = ((size + alignment - 1)/alignment)*alignment;
+#ifdef _WIN32
+    void *p = _aligned_malloc(size, alignment);
+#else
+    void *p = std::aligned_alloc(alignment, size);
+#endif
+    if (p == NULL){
+        throw(std::bad_alloc());
+    }
+    return p;
+}
+
+
+static void aligned_free(void *p){
+
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+
+// Conversion between 32-bit and 16-bit floats, rounding to nearest even
+// as the F16C instructions do
+static inline unsigned short float_to_half(float f){
+
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    unsigned short sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+    // Infinity and NaN
+    if (x >= 0x7f800000){
+        return sign | 0x7c00 | ((x > 0x7f800000) ? 0x200 : 0);
+    }
+    // Values that round to infinity, from 65520 on
+    if (x >= 0x477ff000){
+        return sign | 0x7c00;
+    }
+    // Subnormal values and zero, below 2^-14
+    if (x < 0x38800000){
+        if (x < 0x33000000){
+            return sign;
+        }
+        unsigned int e = x >> 23;
+        unsigned int m = (x & 0x7fffff) | 0x800000;
+        unsigned int shift = 126 - e;
+        unsigned int h = m >> shift;
+        unsigned int rem = m & ((1u << shift) - 1);
+        unsigned int half = 1u << (shift - 1);
+        if ((rem > half) || ((rem == half) && (h & 1))){
+            h++;
+        }
+        return sign | h;
+    }
+    // Normal values, with the exponent rebiased from 127 to 15
+    unsigned int h = (x - 0x38000000) >> 13;
+    unsigned int rem = x & 0x1fff;
+    if ((rem > 0x1000) || ((rem == 0x1000) && (h & 1))){
+        h++;
+    }
+    return sign | h;
+}
+
+
+static inline float half_to_float(unsigned short h){
+
+    unsigned int sign = (h & 0x8000) << 16;
+    unsigned int e = (h >> 10) & 0x1f;
+    unsigned int m = h & 0x3ff;
+    unsigned int x;
+    if (e == 0){
+        // Zero and subnormal values
+        float f = m*(1.0f/16777216.0f);
+        return sign ? -f : f;
+    } else if (e == 31){
+        x = sign | 0x7f800000 | (m << 13);
+    } else {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+
+// Conversion of arrays between 32-bit and 16-bit floats. With GCC and
+// Clang on x86, the F16C instructions are used when the processor has
+// them, even if the library is not compiled for F16C
+#if defined(__F16C__)
+static bool has_f16c(void){
+
+    return true;
+}
+#define GEOMPROC_F16C_TARGET
+#elif (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+static bool has_f16c(void){
+
+    static const bool supported = __builtin_cpu_supports("f16c");
+    return supported;
+}
+#define GEOMPROC_F16C_TARGET __attribute__((target("f16c")))
+#endif
+
+#ifdef GEOMPROC_F16C_TARGET
+GEOMPROC_F16C_TARGET static size_t floats_to_halves_f16c(const float *in, unsigned short *out, size_t count){
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128i h = _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64((__m128i *) (out + i), h);
+    }
+    return i;
+}
+
+
+GEOMPROC_F16C_TARGET static size_t halves_to_floats_f16c(const unsigned short *in, float *out, size_t count){
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4){
+        __m128 x = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *) (in + i)));
+        _mm_storeu_ps(out + i, x);
+    }
+    return i;
+}
+#endif
+
+
+void floats_to_halves(const float *in, unsigned short *out, size_t count){
+
+    size_t i = 0;
+#ifdef GEOMPROC_F16C_TARGET
+    if (has_f16c()){
+        i = floats_to_halves_f16c(in, out, count);
+    }
+#endif
+    for (; i < count; i++){
+        out[i] = float_to_half(in[i]);
+    }
+}
+
+
+void halves_to_floats(const unsigned short *in, float *out, size_t count){
+
+    size_t i = 0;
+#ifdef GEOMPROC_F16C_TARGET
+    if (has_f16c()){
+        i = halves_to_floats_f16c(in, out, count);
+    }
+#endif
+    for (; i < count; i++){
+        out[i] = half_to_float(in[i]);
+    }
+}
+
+
+// Largest quantized value, with the next one marking infinite values
+static const unsigned int QuantizedMax = 65534;
+static const unsigned short QuantizedInfinity = 65535;
+
+
+DistanceMatrix::DistanceMatrix(void){
+
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+    stride_ = 0;
+}
+
+
+DistanceMatrix::DistanceMatrix(size_t rows, size_t cols){
+
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+    stride_ = 0;
+    Resize(rows, cols);
+}
+
+
+DistanceMatrix::DistanceMatrix(const DistanceMatrix &other){
+
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+    stride_ = 0;
+    *this = other;
+}
+
+
+DistanceMatrix &DistanceMatrix::operator=(const DistanceMatrix &other){
+
+    if (this != &other){
+        Resize(other.rows_, other.cols_);
+        if (data_ != NULL){
+            memcpy(data_, other.data_, rows_*stride_*sizeof(float));
+        }
+    }
+    return *this;
+}
+
+
+DistanceMatrix::~DistanceMatrix(){
+
+    Clear();
+}
+
+
+void DistanceMatrix::Resize(size_t rows, size_t cols, float value){
+
+    // Round the rows up to the alignment, so that every row is aligned
+    const size_t align_floats = Alignment/sizeof(float);
+    size_t stride = ((cols + align_floats - 1)/align_floats)*align_floats;
+    if ((rows*stride) != (rows_*stride_)){
+        Clear();
+        if (rows*stride > 0){
+            data_ = (float *) aligned_malloc(Alignment, rows*stride*sizeof(float));
+        }
+    }
+    rows_ = rows;
+    cols_ = cols;
+    stride_ = stride;
+
+    // Initialize the values in parallel, so that the pages of the buffer
+    // are first touched by the threads that will later fill them
+    parallel_for(0, rows_, [this, value](size_t begin, size_t end){
+        std::fill(data_ + begin*stride_, data_ + end*stride_, value);
+    }, 1);
+}
+
+
+void DistanceMatrix::Clear(void){
+
+    aligned_free(data_);
+    data_ = NULL;
+    rows_ = 0;
+    cols_ = 0;
+    stride_ = 0;
+}
+
+
+float DistanceMatrix::Min(size_t row) const {
+
+    const float *r = Row(row);
+    float result = INFINITY;
+    size_t j = 0;
+#ifdef __SSE2__
+    // Rows are aligned, so the values can be loaded with aligned loads
+    __m128 m0 = _mm_set1_ps(INFINITY);
+    __m128 m1 = m0;
+    for (; j + 8 <= cols_; j += 8){
+        m0 = _mm_min_ps(m0, _mm_load_ps(r + j));
+        m1 = _mm_min_ps(m1, _mm_load_ps(r + j + 4));
+    }
+    result = horizontal_min(_mm_min_ps(m0, m1));
+#endif
+    for (; j < cols_; j++){
+        result = std::min(result, r[j]);
+    }
+    return result;
+}
+
+
+size_t DistanceMatrix::ArgMin(size_t row) const {
+
+    const float *r = Row(row);
+    size_t j = 0;
+    float best = INFINITY;
+    size_t best_col = 0;
+#ifdef __SSE2__
+    // Keep the smallest value of each lane and the column where it was
+    // found, then pick the lane with the smallest value and column
+    __m128 value = _mm_set1_ps(INFINITY);
+    __m128i col = _mm_setzero_si128();
+    __m128i current = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i step = _mm_set1_epi32(4);
+    for (; j + 4 <= cols_; j += 4){
+        __m128 x = _mm_load_ps(r + j);
+        __m128 lt = _mm_cmplt_ps(x, value);
+        value = select(lt, x, value);
+        col = _mm_castps_si128(select(lt, _mm_castsi128_ps(current), _mm_castsi128_ps(col)));
+        current = _mm_add_epi32(current, step);
+    }
+    float lane_value[4];
+    int lane_col[4];
+    _mm_storeu_ps(lane_value, value);
+    _mm_storeu_si128((__m128i *) lane_col, col);
+    for (int k = 0; k < 4; k++){
+        if ((lane_value[k] < best) || ((lane_value[k] == best) && ((size_t) lane_col[k] < best_col))){
+            best = lane_value[k];
+            best_col = lane_col[k];
+        }
+    }
+#endif
+    for (; j < cols_; j++){
+        if (r[j] < best){
+            best = r[j];
+            best_col = j;
+        }
+    }
+    return best_col;
+}
+
+
+bool DistanceMatrix::Range(size_t row, float &min, float &max) const {
+
+    return finite_range(Row(row), cols_, min, max);
+}
+
+
+void DistanceMatrix::Normalize(void){
+
+    parallel_for(0, rows_, [this](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            float min, max;
+            if (!Range(i, min, max)){
+                continue;
+            }
+            // Rows with a single finite value are mapped to 0
+            float scale = (max > min) ? 1.0f/(max - min) : 0.0f;
+            float *r = Row(i);
+            size_t j = 0;
+#ifdef __SSE2__
+            __m128 vmin = _mm_set1_ps(min);
+            __m128 vscale = _mm_set1_ps(scale);
+            for (; j + 4 <= cols_; j += 4){
+                __m128 x = _mm_load_ps(r + j);
+                __m128 y = _mm_mul_ps(_mm_sub_ps(x, vmin), vscale);
+                _mm_store_ps(r + j, select(finite_mask(x), y, x));
+            }
+#endif
+            for (; j < cols_; j++){
+                if (std::isfinite(r[j])){
+                    r[j] = (r[j] - min)*scale;
+                }
+            }
+        }
+    }, 1);
+}
+
+
+void DistanceMatrix::ColumnArgMin(std::vector<int> &row, std::vector<float> *value) const {
+
+    row.assign(cols_, -1);
+    if (value != NULL){
+        value->assign(cols_, INFINITY);
+    }
+    if (rows_ == 0){
+        return;
+    }
+
+    // Each thread processes a range of columns, going through the rows
+    // in order so that ties keep the first row
+    parallel_for(0, cols_, [&](size_t begin, size_t end){
+        std::vector<float> best(Row(0) + begin, Row(0) + end);
+        int *best_row = row.data() + begin;
+        std::fill(best_row, best_row + (end - begin), 0);
+        for (size_t i = 1; i < rows_; i++){
+            const float *r = Row(i) + begin;
+            size_t j = 0;
+#ifdef __SSE2__
+            __m128i current = _mm_set1_epi32((int) i);
+            for (; j + 4 <= end - begin; j += 4){
+                __m128 x = _mm_loadu_ps(r + j);
+                __m128 b = _mm_loadu_ps(best.data() + j);
+                __m128 lt = _mm_cmplt_ps(x, b);
+                _mm_storeu_ps(best.data() + j, select(lt, x, b));
+                __m128i br = _mm_loadu_si128((const __m128i *) (best_row + j));
+                br = _mm_castps_si128(select(lt, _mm_castsi128_ps(current), _mm_castsi128_ps(br)));
+                _mm_storeu_si128((__m128i *) (best_row + j), br);
+            }
+#endif
+            for (; j < end - begin; j++){
+                if (r[j] < best[j]){
+                    best[j] = r[j];
+                    best_row[j] = i;
+                }
+            }
+        }
+        if (value != NULL){
+            std::copy(best.begin(), best.end(), value->begin() + begin);
+        }
+    });
+}
+
+
+CompactField::CompactField(void){
+
+    encoding_ = QuantizedEncoding;
+    min_ = INFINITY;
+    max_ = -INFINITY;
+    step_ = 0.0f;
+}
+
+
+void CompactField::SetRange(float min, float max){
+
+    min_ = min;
+    max_ = max;
+    step_ = (max > min) ? (max - min)/QuantizedMax : 0.0f;
+}
+
+
+void CompactField::Encode(const float *field, size_t size, FieldEncoding encoding){
+
+    if ((encoding != HalfEncoding) && (encoding != QuantizedEncoding)){
+        throw(std::ios_base::failure(std::string("Error: invalid encoding of compact field")));
+    }
+    float min, max;
+    bool finite = finite_range(field, size, min, max);
+    if ((encoding == HalfEncoding) && finite && ((std::fabs(min) >= 65520.0f) || (std::fabs(max) >= 65520.0f))){
+        throw(std::ios_base::failure(std::string("Error: field values are too large for half precision")));
+    }
+    encoding_ = encoding;
+    data_.resize(size);
+    unsigned short *out = data_.data();
+
+    if (encoding == HalfEncoding){
+        floats_to_halves(field, out, size);
+        // Keep the range of the values as they are decoded, which rounding
+        // does not reorder
+        if (finite){
+            min = half_to_float(float_to_half(min));
+            max = half_to_float(float_to_half(max));
+        }
+        SetRange(min, max);
+        return;
+    }
+
+    // Quantize the values to steps of (max - min)/QuantizedMax above min
+    SetRange(min, max);
+    float scale = (step_ > 0.0f) ? 1.0f/step_ : 0.0f;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128 vmin = _mm_set1_ps(min);
+    __m128 vscale = _mm_set1_ps(scale);
+    __m128 vlimit = _mm_set1_ps((float) QuantizedMax);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i sign = _mm_set1_epi16((short) 0x8000);
+    const __m128i infinity = _mm_set1_epi16((short) QuantizedInfinity);
+    for (; i + 8 <= size; i += 8){
+        __m128 x0 = _mm_loadu_ps(field + i);
+        __m128 x1 = _mm_loadu_ps(field + i + 4);
+        __m128 y0 = clamp(_mm_mul_ps(_mm_sub_ps(x0, vmin), vscale), _mm_setzero_ps(), vlimit);
+        __m128 y1 = clamp(_mm_mul_ps(_mm_sub_ps(x1, vmin), vscale), _mm_setzero_ps(), vlimit);
+        // SSE2 only packs with signed saturation, so the values are moved
+        // to the signed range and back
+        __m128i q0 = _mm_sub_epi32(_mm_cvtps_epi32(y0), bias);
+        __m128i q1 = _mm_sub_epi32(_mm_cvtps_epi32(y1), bias);
+        __m128i q = _mm_xor_si128(_mm_packs_epi32(q0, q1), sign);
+        __m128i finite = _mm_packs_epi32(_mm_castps_si128(finite_mask(x0)), _mm_castps_si128(finite_mask(x1)));
+        q = _mm_or_si128(_mm_and_si128(finite, q), _mm_andnot_si128(finite, infinity));
+        _mm_storeu_si128((__m128i *) (out + i), q);
+    }
+#endif
+    for (; i < size; i++){
+        if (std::isfinite(field[i])){
+            float y = std::min(std::max((field[i] - min)*scale, 0.0f), (float) QuantizedMax);
+            out[i] = (unsigned short) std::nearbyint(y);
+        } else {
+            out[i] = QuantizedInfinity;
+        }
+    }
+}
+
+
+void CompactField::Assign(FieldEncoding encoding, float min, float max, const unsigned short *data, size_t size){
+
+    if ((encoding != HalfEncoding) && (encoding != QuantizedEncoding)){
+        throw(std::ios_base::failure(std::string("Error: invalid encoding of compact field")));
+    }
+    encoding_ = encoding;
+    SetRange(min, max);
+    data_.assign(data, data + size);
+}
+
+
+void CompactField::Decode(float *field, size_t begin, size_t end) const {
+
+    const unsigned short *in = data_.data();
+    if (encoding_ == HalfEncoding){
+        halves_to_floats(in + begin, field, end - begin);
+        return;
+    }
+
+    size_t i = begin;
+#ifdef __SSE2__
+    __m128 vmin = _mm_set1_ps(min_);
+    __m128 vstep = _mm_set1_ps(step_);
+    __m128 inf = _mm_set1_ps(INFINITY);
+    const __m128i infinity = _mm_set1_epi32(QuantizedInfinity);
+    for (; i + 8 <= end; i += 8){
+        __m128i q = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i q0 = _mm_unpacklo_epi16(q, _mm_setzero_si128());
+        __m128i q1 = _mm_unpackhi_epi16(q, _mm_setzero_si128());
+        __m128 y0 = _mm_add_ps(vmin, _mm_mul_ps(_mm_cvtepi32_ps(q0), vstep));
+        __m128 y1 = _mm_add_ps(vmin, _mm_mul_ps(_mm_cvtepi32_ps(q1), vstep));
+        y0 = select(_mm_castsi128_ps(_mm_cmpeq_epi32(q0, infinity)), inf, y0);
+        y1 = select(_mm_castsi128_ps(_mm_cmpeq_epi32(q1, infinity)), inf, y1);
+        _mm_storeu_ps(field + (i - begin), y0);
+        _mm_storeu_ps(field + (i - begin) + 4, y1);
+    }
+#endif
+    for (; i < end; i++){
+        field[i - begin] = Get(i);
+    }
+}
+
+
+float CompactField::Get(size_t i) const {
+
+    unsigned short q = data_[i];
+    if (encoding_ == HalfEncoding){
+        return half_to_float(q);
+    }
+    if (q == QuantizedInfinity){
+        return INFINITY;
+    }
+    return min_ + q*step_;
+}
+
+
+bool CompactField::Range(float &min, float &max) const {
+
+    min = min_;
+    max = max_;
+    return min <= max;
+}
+
+
+float CompactField::ErrorBound(void) const {
+
+    if (min_ > max_){
+        return 0.0f;
+    }
+    float largest = std::max(std::fabs(min_), std::fabs(max_));
+    if (encoding_ == HalfEncoding){
+        return std::max(largest*(1.0f/2048.0f), 1.0f/33554432.0f);
+    }
+    // Half a step, and the rounding of the float operations of encoding
+    // and decoding
+    return 0.5f*step_ + largest*(1.0f/4194304.0f);
+}
+
+
+size_t CompactField::ArgMin(void) const {
+
+    // Quantized values are ordered as the values they encode. Half values
+    // are ordered once the bits of negative values are flipped
+    size_t best = 0;
+    unsigned int best_key = UINT_MAX;
+    for (size_t i = 0; i < data_.size(); i++){
+        unsigned int h = data_[i];
+        unsigned int key = h;
+        if (encoding_ == HalfEncoding){
+            key = (h & 0x8000) ? ((~h) & 0xffff) : (h | 0x8000);
+        }
+        if (key < best_key){
+            best_key = key;
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+} // namespace GeomProc
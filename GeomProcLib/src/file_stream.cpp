@@ -0,0 +1,539 @@
+#include <file_stream.h>
+#include <utils.h>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#ifdef GEOMPROC_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GEOMPROC_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace GeomProc {
+
+
+// Size of the blocks read from a compressed file and of the decoded blocks
+static const size_t CompressedBlockSize = 1 << 18;
+static const size_t DecodedBlockSize = 1 << 20;
+// Number of decoded blocks that can wait to be read
+static const size_t MaxQueuedBlocks = 4;
+
+
+Compression detect_compression(const char *data, size_t size){
+
+    const unsigned char *b = (const unsigned char *) data;
+    if ((size >= 2) && (b[0] == 0x1f) && (b[1] == 0x8b)){
+        return GzipCompression;
+    }
+    if ((size >= 4) && (b[0] == 0x28) && (b[1] == 0xb5) && (b[2] == 0x2f) && (b[3] == 0xfd)){
+        return ZstdCompression;
+    }
+    return NoCompression;
+}
+
+
+Compression file_compression(const char *filename){
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    char magic[4];
+    size_t size = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return detect_compression(magic, size);
+}
+
+
+Compression extension_compression(const std::string &filename){
+
+    std::string ext = get_extension(filename);
+    if ((ext == std::string("gz")) || (ext == std::string("GZ"))){
+        return GzipCompression;
+    } else if ((ext == std::string("zst")) || (ext == std::string("ZST"))){
+        return ZstdCompression;
+    }
+    return NoCompression;
+}
+
+
+std::string mesh_extension(const std::string &filename){
+
+    if (extension_compression(filename) != NoCompression){
+        return get_extension(filename.substr(0, filename.rfind('.')));
+    }
+    return get_extension(filename);
+}
+
+
+InputStream::InputStream(void){
+
+    file_ = NULL;
+    compression_ = NoCompression;
+    position_ = 0;
+    done_ = false;
+    stop_ = false;
+}
+
+
+InputStream::~InputStream(){
+
+    Close();
+}
+
+
+void InputStream::Open(const char *filename){
+
+    Close();
+
+    // Open file and check for errors
+    file_ = fopen(filename, "rb");
+    if (file_ == NULL){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    filename_ = filename;
+
+    // Check the magic bytes
+    char magic[4];
+    size_t size = fread(magic, 1, sizeof(magic), file_);
+    compression_ = detect_compression(magic, size);
+    if (fseek(file_, 0, SEEK_SET) != 0){
+        Close();
+        throw(std::ios_base::failure(std::string("Error reading file ")+std::string(filename)));
+    }
+#ifndef GEOMPROC_HAS_ZLIB
+    if (compression_ == GzipCompression){
+        Close();
+        throw(std::ios_base::failure(std::string("Error: file ")+std::string(filename)+std::string(" is compressed with gzip, but the library was built without zlib")));
+    }
+#endif
+#ifndef GEOMPROC_HAS_ZSTD
+    if (compression_ == ZstdCompression){
+        Close();
+        throw(std::ios_base::failure(std::string("Error: file ")+std::string(filename)+std::string(" is compressed with zstd, but the library was built without zstd")));
+    }
+#endif
+
+    // Start decoding
+    if (compression_ != NoCompression){
+        done_ = false;
+        stop_ = false;
+        thread_ = std::thread(&InputStream::Decode, this);
+    }
+}
+
+
+void InputStream::Close(void){
+
+    // Stop the decoding thread
+    if (thread_.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+    if (file_ != NULL){
+        fclose(file_);
+        file_ = NULL;
+    }
+    queue_.clear();
+    current_.clear();
+    position_ = 0;
+    error_ = NULL;
+    compression_ = NoCompression;
+}
+
+
+size_t InputStream::Read(char *data, size_t size){
+
+    if (file_ == NULL){
+        return 0;
+    }
+
+    // Read uncompressed files directly
+    if (compression_ == NoCompression){
+        size_t count = fread(data, 1, size, file_);
+        if ((count < size) && ferror(file_)){
+            throw(std::ios_base::failure(std::string("Error reading file ")+filename_));
+        }
+        return count;
+    }
+
+    // Copy from the decoded blocks, waiting for the next block when the
+    // current one has been read
+    size_t count = 0;
+    while (count < size){
+        if (position_ == current_.size()){
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this](){ return (!queue_.empty()) || done_; });
+            if (queue_.empty()){
+                if (error_){
+                    std::exception_ptr error = error_;
+                    error_ = NULL;
+                    std::rethrow_exception(error);
+                }
+                break;
+            }
+            current_.swap(queue_.front());
+            queue_.pop_front();
+            position_ = 0;
+            cond_.notify_all();
+        }
+        size_t n = std::min(size - count, current_.size() - position_);
+        memcpy(data + count, current_.data() + position_, n);
+        count += n;
+        position_ += n;
+    }
+    return count;
+}
+
+
+bool InputStream::Push(std::vector<char> &block){
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this](){ return (queue_.size() < MaxQueuedBlocks) || stop_; });
+    if (stop_){
+        return false;
+    }
+    queue_.push_back(std::vector<char>());
+    queue_.back().swap(block);
+    cond_.notify_all();
+    return true;
+}
+
+
+void InputStream::Decode(void){
+
+    try {
+        if (compression_ == GzipCompression){
+            DecodeGzip();
+        } else {
+            DecodeZstd();
+        }
+    } catch (...){
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    cond_.notify_all();
+}
+
+
+void InputStream::DecodeGzip(void){
+
+#ifdef GEOMPROC_HAS_ZLIB
+    z_stream zs;
+    memset(&zs, 0, sizeof(z_stream));
+    // Accept gzip and zlib headers
+    if (inflateInit2(&zs, 15 + 32) != Z_OK){
+        throw(std::ios_base::failure(std::string("Error: could not initialize gzip decoder")));
+    }
+    std::vector<char> in(CompressedBlockSize);
+    std::vector<char> out(DecodedBlockSize);
+    size_t out_size = 0;
+    bool eof = false;
+    int ret = Z_OK;
+    try {
+        while (true){
+            // Read more compressed data
+            if ((zs.avail_in == 0) && (!eof)){
+                size_t count = fread(in.data(), 1, in.size(), file_);
+                if (count == 0){
+                    if (ferror(file_)){
+                        throw(std::ios_base::failure(std::string("Error reading file ")+filename_));
+                    }
+                    eof = true;
+                }
+                zs.next_in = (Bytef *) in.data();
+                zs.avail_in = count;
+            }
+            if ((zs.avail_in == 0) && eof){
+                if (ret != Z_STREAM_END){
+                    throw(std::ios_base::failure(std::string("Error: compressed file ")+filename_+std::string(" is truncated")));
+                }
+                break;
+            }
+
+            // Decode into the output block
+            zs.next_out = (Bytef *) out.data() + out_size;
+            zs.avail_out = out.size() - out_size;
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END){
+                // Another gzip member may follow
+                inflateReset(&zs);
+            } else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)){
+                throw(std::ios_base::failure(std::string("Error decompressing file ")+filename_));
+            }
+            out_size = out.size() - zs.avail_out;
+            if (out_size == out.size()){
+                if (!Push(out)){
+                    break;
+                }
+                out.resize(DecodedBlockSize);
+                out_size = 0;
+            }
+        }
+        if (out_size > 0){
+            out.resize(out_size);
+            Push(out);
+        }
+    } catch (...){
+        inflateEnd(&zs);
+        throw;
+    }
+    inflateEnd(&zs);
+#endif
+}
+
+
+void InputStream::DecodeZstd(void){
+
+#ifdef GEOMPROC_HAS_ZSTD
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (dctx == NULL){
+        throw(std::ios_base::failure(std::string("Error: could not initialize zstd decoder")));
+    }
+    std::vector<char> in(CompressedBlockSize);
+    std::vector<char> out(DecodedBlockSize);
+    size_t out_size = 0;
+    // Zero when the last frame is complete
+    size_t last = 0;
+    bool stopped = false;
+    try {
+        size_t count;
+        while ((!stopped) && ((count = fread(in.data(), 1, in.size(), file_)) > 0)){
+            ZSTD_inBuffer input = { in.data(), count, 0 };
+            // Keep decoding while there is input or the decoder may hold
+            // more output
+            bool full = true;
+            while ((input.pos < input.size) || full){
+                ZSTD_outBuffer output = { out.data(), out.size(), out_size };
+                last = ZSTD_decompressStream(dctx, &output, &input);
+                if (ZSTD_isError(last)){
+                    throw(std::ios_base::failure(std::string("Error decompressing file ")+filename_+std::string(": ")+std::string(ZSTD_getErrorName(last))));
+                }
+                out_size = output.pos;
+                full = (out_size == out.size());
+                if (full){
+                    if (!Push(out)){
+                        stopped = true;
+                        break;
+                    }
+                    out.resize(DecodedBlockSize);
+                    out_size = 0;
+                }
+            }
+        }
+        if (!stopped){
+            if (ferror(file_)){
+                throw(std::ios_base::failure(std::string("Error reading file ")+filename_));
+            }
+            if (last != 0){
+                throw(std::ios_base::failure(std::string("Error: compressed file ")+filename_+std::string(" is truncated")));
+            }
+            if (out_size > 0){
+                out.resize(out_size);
+                Push(out);
+            }
+        }
+    } catch (...){
+        ZSTD_freeDCtx(dctx);
+        throw;
+    }
+    ZSTD_freeDCtx(dctx);
+#endif
+}
+
+
+OutputFile::OutputFile(void){
+
+    file_ = NULL;
+    compression_ = NoCompression;
+    stream_ = NULL;
+    ok_ = true;
+}
+
+
+OutputFile::~OutputFile(){
+
+    // Release the compressor and the file without reporting errors
+#ifdef GEOMPROC_HAS_ZLIB
+    if ((stream_ != NULL) && (compression_ == GzipCompression)){
+        deflateEnd((z_stream *) stream_);
+        delete (z_stream *) stream_;
+    }
+#endif
+#ifdef GEOMPROC_HAS_ZSTD
+    if ((stream_ != NULL) && (compression_ == ZstdCompression)){
+        ZSTD_freeCCtx((ZSTD_CCtx *) stream_);
+    }
+#endif
+    if (file_ != NULL){
+        fclose(file_);
+    }
+}
+
+
+void OutputFile::Open(const char *filename){
+
+    // Check if the compression is available
+    compression_ = extension_compression(filename);
+#ifndef GEOMPROC_HAS_ZLIB
+    if (compression_ == GzipCompression){
+        throw(std::ios_base::failure(std::string("Error: cannot write ")+std::string(filename)+std::string(", the library was built without zlib")));
+    }
+#endif
+#ifndef GEOMPROC_HAS_ZSTD
+    if (compression_ == ZstdCompression){
+        throw(std::ios_base::failure(std::string("Error: cannot write ")+std::string(filename)+std::string(", the library was built without zstd")));
+    }
+#endif
+
+    // Open file and check for errors
+    file_ = fopen(filename, "wb");
+    if (file_ == NULL){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    filename_ = filename;
+    ok_ = true;
+
+    // Set up compressor
+    if (compression_ != NoCompression){
+        buffer_.resize(CompressedBlockSize);
+    }
+#ifdef GEOMPROC_HAS_ZLIB
+    if (compression_ == GzipCompression){
+        z_stream *zs = new z_stream;
+        memset(zs, 0, sizeof(z_stream));
+        // Write a gzip header
+        if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+            delete zs;
+            throw(std::ios_base::failure(std::string("Error: could not initialize gzip encoder")));
+        }
+        stream_ = zs;
+    }
+#endif
+#ifdef GEOMPROC_HAS_ZSTD
+    if (compression_ == ZstdCompression){
+        ZSTD_CCtx *cctx = ZSTD_createCCtx();
+        if (cctx == NULL){
+            throw(std::ios_base::failure(std::string("Error: could not initialize zstd encoder")));
+        }
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+        stream_ = cctx;
+    }
+#endif
+}
+
+
+void OutputFile::WriteBuffer(size_t size){
+
+    if (ok_ && (size > 0)){
+        ok_ = (fwrite(buffer_.data(), 1, size, file_) == size);
+    }
+}
+
+
+void OutputFile::Write(const void *data, size_t size){
+
+    if (compression_ == NoCompression){
+        if (ok_ && (size > 0)){
+            ok_ = (fwrite(data, 1, size, file_) == size);
+        }
+        return;
+    }
+#ifdef GEOMPROC_HAS_ZLIB
+    if (compression_ == GzipCompression){
+        z_stream *zs = (z_stream *) stream_;
+        const char *p = (const char *) data;
+        while (size > 0){
+            // The input size of zlib is limited to an unsigned int
+            size_t piece = std::min<size_t>(size, UINT_MAX);
+            zs->next_in = (Bytef *) p;
+            zs->avail_in = piece;
+            do {
+                zs->next_out = (Bytef *) buffer_.data();
+                zs->avail_out = buffer_.size();
+                deflate(zs, Z_NO_FLUSH);
+                WriteBuffer(buffer_.size() - zs->avail_out);
+            } while (zs->avail_out == 0);
+            p += piece;
+            size -= piece;
+        }
+    }
+#endif
+#ifdef GEOMPROC_HAS_ZSTD
+    if (compression_ == ZstdCompression){
+        ZSTD_inBuffer input = { data, size, 0 };
+        while (input.pos < input.size){
+            ZSTD_outBuffer output = { buffer_.data(), buffer_.size(), 0 };
+            size_t ret = ZSTD_compressStream2((ZSTD_CCtx *) stream_, &output, &input, ZSTD_e_continue);
+            if (ZSTD_isError(ret)){
+                ok_ = false;
+                break;
+            }
+            WriteBuffer(output.pos);
+        }
+    }
+#endif
+}
+
+
+void OutputFile::Close(void){
+
+    if (file_ == NULL){
+        return;
+    }
+
+    // Finish the compressed stream
+#ifdef GEOMPROC_HAS_ZLIB
+    if (compression_ == GzipCompression){
+        z_stream *zs = (z_stream *) stream_;
+        int ret;
+        do {
+            zs->next_out = (Bytef *) buffer_.data();
+            zs->avail_out = buffer_.size();
+            ret = deflate(zs, Z_FINISH);
+            WriteBuffer(buffer_.size() - zs->avail_out);
+        } while (ret == Z_OK);
+        ok_ = ok_ && (ret == Z_STREAM_END);
+        deflateEnd(zs);
+        delete zs;
+        stream_ = NULL;
+    }
+#endif
+#ifdef GEOMPROC_HAS_ZSTD
+    if (compression_ == ZstdCompression){
+        ZSTD_inBuffer input = { NULL, 0, 0 };
+        size_t remaining;
+        do {
+            ZSTD_outBuffer output = { buffer_.data(), buffer_.size(), 0 };
+            remaining = ZSTD_compressStream2((ZSTD_CCtx *) stream_, &output, &input, ZSTD_e_end);
+            if (ZSTD_isError(remaining)){
+                ok_ = false;
+                break;
+            }
+            WriteBuffer(output.pos);
+        } while (remaining != 0);
+        ZSTD_freeCCtx((ZSTD_CCtx *) stream_);
+        stream_ = NULL;
+    }
+#endif
+
+    // Close file
+    bool ok = (fclose(file_) == 0) && ok_;
+    file_ = NULL;
+    if (!ok){
+        throw(std::ios_base::failure(std::string("Error writing file ")+filename_));
+    }
+}
+
+
+} // namespace GeomProc
@@ -1,8 +1,11 @@
 #include <graph_dist.h>
+#include <utils.h>
 #include <glm/geometric.hpp>
-#include <queue>
+#include <algorithm>
 #include <utility>
 #include <cmath>
+#include <atomic>
+#include <mutex>
 // For debug
 #include <iostream>
 
@@ -10,15 +13,76 @@
 namespace GeomProc {
 
 
-void GraphDist::ComputeVertexShortestPath(int source_index){
+// Call func(thread, source_index) for every source index in [0, count),
+// using get_num_threads() threads that each take the next source when
+// they are done with the previous one, since the time per source varies.
+// After an exception, no further sources are started
+template <typename Func> static void for_each_source(size_t count, Func func){
 
-    // Check index of source
-    if ((source_index < 0) || (source_index >= mesh_.VertexCount())){
+    int threads = (int) std::min<size_t>(get_num_threads(), count);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    parallel_invoke(threads, [&](int thread){
+        try {
+            for (size_t i = next++; (i < count) && (!failed); i = next++){
+                func(thread, i);
+            }
+        } catch (...){
+            failed = true;
+            throw;
+        }
+    });
+}
+
+
+GraphDistWorkspace::GraphDistWorkspace(void){
+
+    generation_ = 0;
+}
+
+
+void GraphDistWorkspace::Begin(size_t size){
+
+    // Resizing keeps the stamps of the existing entries, which belong to
+    // earlier generations
+    if (dist_.size() != size){
+        dist_.resize(size);
+        stamp_.resize(size, 0);
+        settled_.resize(size, 0);
+    }
+
+    // Advance the generation, which invalidates all the distances. Stamps
+    // are only cleared when the counter wraps around
+    generation_++;
+    if (generation_ == 0){
+        std::fill(stamp_.begin(), stamp_.end(), 0);
+        std::fill(settled_.begin(), settled_.end(), 0);
+        generation_ = 1;
+    }
+    touched_.clear();
+    vertex_heap_.clear();
+    face_heap_.clear();
+}
+
+
+void GraphDistWorkspace::GetField(float *field) const {
+
+    std::fill(field, field + dist_.size(), INFINITY);
+    for (size_t i = 0; i < touched_.size(); i++){
+        field[touched_[i]] = dist_[touched_[i]];
+    }
+}
+
+
+void GraphDist::ComputeVertexShortestPath(IdType source_id, GraphDistWorkspace &workspace){
+
+    // Check id of source
+    if ((source_id < 0) || (source_id >= mesh_.VertexCount())){
         throw(std::ios_base::failure(std::string("Invalid source index")));
     }
 
-    // Initialize distance field with infinite values
-    dist.push_back(std::vector<float>(mesh_.VertexCount(), INFINITY));
+    // Reset distances to infinite values
+    workspace.Begin(mesh_.VertexCount());
 
     // Compute shortest path for source vertex
 
@@ -26,57 +90,81 @@ void GraphDist::ComputeVertexShortestPath(int source_index){
     // Pair composed of distance, vertex
     typedef std::pair<float, VertexPtr> FieldPair;
 
-    // Priority queue for using Dijkstra's algorithm efficiently
-    std::priority_queue< FieldPair, std::vector <FieldPair>, std::greater<FieldPair> > pq; 
+    // Priority queue for using Dijkstra's algorithm efficiently, kept as
+    // a binary heap in the storage of the workspace
+    std::vector<FieldPair> &pq = workspace.vertex_heap_;
+    std::greater<FieldPair> order;
   
+    // Lengths of the edges, kept by the mesh
+    const EdgeTable &edges = mesh_.GetEdgeTable();
+
     // Get source to be processed
-    IdType source_id = sources[source_index];
     VertexPtr source = mesh_.GetVertex(source_id);
 
     // Insert source to priority queue and initialize its distance to 0
-    pq.push(std::make_pair(0.0, source)); 
-    dist[source_index][source_id] = 0.0; 
+    pq.push_back(std::make_pair(0.0, source)); 
+    workspace.SetDistance(source_id, 0.0); 
   
     // Process the priority queue
     while (!pq.empty()){ 
         // Extract top element and its id
-        VertexPtr current = pq.top().second; 
-        pq.pop(); 
+        std::pop_heap(pq.begin(), pq.end(), order);
+        VertexPtr current = pq.back().second; 
+        pq.pop_back(); 
         int current_id = current->GetId();
-  
-        // Go through the neighbors of the top element
-        VertexResultContainer neigh = current->GetNeighbors();
-        VertexResultContainer::iterator nit, nend;
-        nit = neigh.begin();
-        nend = neigh.end();
-        for (; nit != nend; nit++){
-            // Get neighbor vertex and its id
-            VertexPtr n = (*nit);
-            int n_id = n->GetId();
 
-            // Compute distance between current and its neighbor
-            float weight = glm::distance(current->GetPosition(), n->GetPosition());
+        // Skip elements that were queued again with a shorter distance and
+        // have already been processed
+        if (!workspace.Settle(current_id)){
+            continue;
+        }
+        float current_dist = workspace.Distance(current_id);
   
-            //  Check if there is a shorter path to n through current
-            if (dist[source_index][n_id] > dist[source_index][current_id] + weight){ 
-                // Update distance of n
-                dist[source_index][n_id] = dist[source_index][current_id] + weight; 
-                pq.push(std::make_pair(dist[source_index][n_id], n)); 
-            } 
+        // Go through the neighbors of the top element, which are the other
+        // two vertices of each of its faces. Neighbors shared by two faces
+        // are visited twice, which does not change the result
+        IdType face_count = current->FaceCount();
+        for (IdType f = 0; f < face_count; f++){
+            FacePtr face = current->GetFace(f);
+            IdType face_id = face->GetId();
+
+            // Corner of the top element in the face
+            int k = 0;
+            while ((k < 2) && (face->GetVertex(k) != current)){
+                k++;
+            }
+
+            // The edges from corner k to k+1 and from k+2 to k lead to the
+            // neighbors
+            for (int e = 1; e <= 2; e++){
+                VertexPtr n = face->GetVertex((k+e)%3);
+                int n_id = n->GetId();
+
+                // Distance between current and its neighbor
+                float weight = edges.length[edges.face_edge[3*face_id + ((e == 1) ? k : (k+2)%3)]];
+
+                //  Check if there is a shorter path to n through current
+                if (workspace.Distance(n_id) > current_dist + weight){ 
+                    // Update distance of n
+                    workspace.SetDistance(n_id, current_dist + weight); 
+                    pq.push_back(std::make_pair(current_dist + weight, n)); 
+                    std::push_heap(pq.begin(), pq.end(), order);
+                } 
+            }
         } 
     } 
 }
 
 
-void GraphDist::ComputeFaceShortestPath(int source_index){
+void GraphDist::ComputeFaceShortestPath(IdType source_id, GraphDistWorkspace &workspace){
 
-    // Check index of source
-    if ((source_index < 0) || (source_index >= mesh_.FaceCount())){
+    // Check id of source
+    if ((source_id < 0) || (source_id >= mesh_.FaceCount())){
         throw(std::ios_base::failure(std::string("Invalid source index")));
     }
 
-    // Initialize distance field with infinite values
-    dist.push_back(std::vector<float>(mesh_.FaceCount(), INFINITY));
+    // Reset distances to infinite values
+    workspace.Begin(mesh_.FaceCount());
 
     // Compute shortest path for source face
 
@@ -84,42 +172,54 @@ void GraphDist::ComputeFaceShortestPath(int source_index){
     // Pair composed of distance, face
     typedef std::pair<float, FacePtr> FieldPair;
 
-    // Priority queue for using Dijkstra's algorithm efficiently
-    std::priority_queue< FieldPair, std::vector <FieldPair>, std::greater<FieldPair> > pq; 
+    // Priority queue for using Dijkstra's algorithm efficiently, kept as
+    // a binary heap in the storage of the workspace
+    std::vector<FieldPair> &pq = workspace.face_heap_;
+    std::greater<FieldPair> order;
   
+    // Centroids of the faces, kept by the mesh
+    const std::vector<PositionType> &centroid = mesh_.GetFaceCentroids();
+
     // Get source to be processed
-    IdType source_id = sources[source_index];
     FacePtr source = mesh_.GetFace(source_id);
 
     // Insert source to priority queue and initialize its distance to 0
-    pq.push(std::make_pair(0.0, source)); 
-    dist[source_index][source_id] = 0.0; 
+    pq.push_back(std::make_pair(0.0, source)); 
+    workspace.SetDistance(source_id, 0.0); 
   
     // Process the priority queue
     while (!pq.empty()){ 
         // Extract top element and its id
-        FacePtr current = pq.top().second; 
-        pq.pop(); 
+        std::pop_heap(pq.begin(), pq.end(), order);
+        FacePtr current = pq.back().second; 
+        pq.pop_back(); 
         int current_id = current->GetId();
+
+        // Skip elements that were queued again with a shorter distance and
+        // have already been processed
+        if (!workspace.Settle(current_id)){
+            continue;
+        }
+        float current_dist = workspace.Distance(current_id);
   
         // Go through the neighbors of the top element
-        FaceResultContainer neigh = current->GetNeighbors();
-        FaceResultContainer::iterator nit, nend;
-        nit = neigh.begin();
-        nend = neigh.end();
+        Face::NeighborIterator nit, nend;
+        nit = current->NeighborBegin();
+        nend = current->NeighborEnd();
         for (; nit != nend; nit++){
             // Get neighbor vertex and its id
             FacePtr n = (*nit);
             int n_id = n->GetId();
 
             // Compute distance between current and its neighbor
-            float weight = glm::distance(current->GetCentroid(), n->GetCentroid());
+            float weight = glm::distance(centroid[current_id], centroid[n_id]);
   
             //  Check if there is a shorter path to n through current
-            if (dist[source_index][n_id] > dist[source_index][current_id] + weight){ 
+            if (workspace.Distance(n_id) > current_dist + weight){ 
                 // Update distance of n
-                dist[source_index][n_id] = dist[source_index][current_id] + weight; 
-                pq.push(std::make_pair(dist[source_index][n_id], n)); 
+                workspace.SetDistance(n_id, current_dist + weight); 
+                pq.push_back(std::make_pair(current_dist + weight, n)); 
+                std::push_heap(pq.begin(), pq.end(), order);
             } 
         } 
     } 
@@ -127,23 +227,103 @@ void GraphDist::ComputeFaceShortestPath(int source_index){
 }
 
 
+void GraphDist::ComputeShortestPath(IdType source_id, GraphDistWorkspace &workspace){
+
+    if (field_type == VertexDist){
+        ComputeVertexShortestPath(source_id, workspace);
+    } else if (field_type == FaceDist){
+        ComputeFaceShortestPath(source_id, workspace);
+    } else {
+        throw(std::ios_base::failure(std::string("Invalid field type")));
+    }
+}
+
+
+void GraphDist::ComputeShortestPath(size_t source_index, float *field, GraphDistWorkspace &workspace){
+
+    // Check index of source
+    if (source_index >= sources.size()){
+        throw(std::ios_base::failure(std::string("Invalid source index")));
+    }
+    ComputeShortestPath(sources[source_index], workspace);
+    workspace.GetField(field);
+}
+
+
+void GraphDist::PrepareWorkspaces(size_t count){
+
+    if (workspace_.size() < count){
+        workspace_.resize(count);
+    }
+}
+
+
+size_t GraphDist::FieldSize(void) const {
+
+    if (field_type == FaceDist){
+        return mesh_.FaceCount();
+    }
+    return mesh_.VertexCount();
+}
+
+
 void GraphDist::ComputeShortestPaths(void){
 
     // Reset distance fields
+    size_t size = FieldSize();
     dist.clear();
+    matrix.Clear();
+    compact.clear();
+    if (storage_type == MatrixStorage){
+        matrix.Resize(sources.size(), size);
+    } else if (storage_type == CompactStorage){
+        compact.resize(sources.size());
+    } else {
+        dist.assign(sources.size(), DistanceField(size));
+    }
+
+    // Each thread uses its own workspace. Compact fields are computed in
+    // a buffer of each thread and then encoded
+    size_t threads = std::min<size_t>(get_num_threads(), sources.size());
+    PrepareWorkspaces(threads);
+    std::vector<DistanceField> buffer;
+    if (storage_type == CompactStorage){
+        buffer.resize(threads);
+    }
 
     // Compute distance field for each source
-    if (field_type == VertexDist){
-        for (int i = 0; i < sources.size(); i++){
-            ComputeVertexShortestPath(i);
+    for_each_source(sources.size(), [&](int thread, size_t i){
+        if (storage_type == MatrixStorage){
+            ComputeShortestPath(i, matrix.Row(i), workspace_[thread]);
+        } else if (storage_type == CompactStorage){
+            DistanceField &field = buffer[thread];
+            field.resize(size);
+            ComputeShortestPath(i, field.data(), workspace_[thread]);
+            compact[i].Encode(field.data(), size, compact_encoding);
+        } else {
+            ComputeShortestPath(i, dist[i].data(), workspace_[thread]);
         }
-    } else if (field_type == FaceDist){
-        for (int i = 0; i < sources.size(); i++){
-            ComputeFaceShortestPath(i);
-        }
-    } else {
-        throw(std::ios_base::failure(std::string("Invalid field type")));
-    }
+    });
+}
+
+
+void GraphDist::ComputeShortestPaths(const FieldSink &sink){
+
+    // Each thread computes its fields in its own workspace and buffer
+    size_t size = FieldSize();
+    size_t threads = std::min<size_t>(get_num_threads(), sources.size());
+    PrepareWorkspaces(threads);
+    std::vector<DistanceField> buffer(threads);
+    std::mutex sink_mutex;
+
+    // Compute distance field for each source and hand it to the sink
+    for_each_source(sources.size(), [&](int thread, size_t i){
+        DistanceField &field = buffer[thread];
+        field.resize(size);
+        ComputeShortestPath(i, field.data(), workspace_[thread]);
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        sink(i, field.data(), size);
+    });
 }
 
 
@@ -6,6 +6,11 @@
 #include <exception>
 #include <fstream>
 #include <sstream>
+#include <atomic>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
 // For debug
 #include <iostream>
 
@@ -13,8 +18,68 @@
 namespace GeomProc {
 
 
+// Source of the versions of all meshes
+static std::atomic<unsigned long long> mesh_version_counter(0);
+
+
+// Version of the geometry of a mesh and quantities derived from it. The
+// cache is allocated separately from the mesh and shared with its
+// vertices, which assign a new version and mark it dirty when their
+// position changes. Exchanging the contents of two meshes exchanges their
+// caches along with the vertices
+struct MeshGeometryCache {
+    // Flags of the entries
+    enum Entry {
+        FaceCentroids = 1,
+        FaceAreas = 2,
+        EdgeGeometry = 4,
+        VertexAreas = 8,
+        BoundingBox = 16,
+        AllEntries = 31
+    };
+
+    // Version of the mesh
+    std::atomic<unsigned long long> version;
+    // Entries that need to be recomputed
+    std::atomic<unsigned int> dirty;
+    // Held while an entry is computed
+    std::mutex mutex;
+
+    std::vector<PositionType> face_centroid;
+    std::vector<AreaType> face_area;
+    std::vector<AreaType> vertex_area;
+    PositionType box_min;
+    PositionType box_max;
+
+    MeshGeometryCache(void) : version(++mesh_version_counter), dirty(AllEntries) { }
+
+    // Assign a new version and mark all the entries dirty
+    void Modified(void){
+
+        version.store(++mesh_version_counter, std::memory_order_release);
+        dirty.store(AllEntries, std::memory_order_release);
+    }
+
+    // Compute an entry with compute() if it is dirty. Threads that find
+    // the entry dirty wait for the first one to compute it
+    template <typename Func> void Update(unsigned int entry, Func compute){
+
+        if ((dirty.load(std::memory_order_acquire) & entry) == 0){
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if ((dirty.load(std::memory_order_acquire) & entry) == 0){
+            return;
+        }
+        compute();
+        dirty.fetch_and(~entry, std::memory_order_release);
+    }
+};
+
+
 Vertex::Vertex(IdType id){
     id_ = id;
+    geometry_cache_ = NULL;
 }
 
 
@@ -45,6 +110,9 @@ UVType Vertex::GetUV(void) const {
 
 void Vertex::SetPosition(const PositionType position){
     position_ = position;
+    if (geometry_cache_ != NULL){
+        geometry_cache_->Modified();
+    }
 }
 
 
@@ -98,38 +166,115 @@ void Vertex::RemoveFace(IdType id){
 }
 
 
+// Order faces by id
+static bool FaceIdLess(FacePtr face1, FacePtr face2){
+
+    return face1->GetId() < face2->GetId();
+}
+
+
 void Vertex::RemoveFace(FacePtr face){
-    
+
+    // The faces of a vertex are normally sorted by id, so try a binary
+    // search first and only scan the list if the face is not found
     FaceInVertexContainer::iterator it;
-    it = std::find(face_.begin(), face_.end(), face);
+    it = std::lower_bound(face_.begin(), face_.end(), face, FaceIdLess);
+    if ((it == face_.end()) || ((*it) != face)){
+        it = std::find(face_.begin(), face_.end(), face);
+    }
     if (it != face_.end()){
         face_.erase(it);
     }
 }
 
 
+Vertex::NeighborIterator::NeighborIterator(VertexPtr vertex, IdType face_index){
+
+    vertex_ = vertex;
+    face_index_ = face_index;
+    corner_index_ = 0;
+
+    // Move to the first neighbor
+    if ((face_index_ < vertex_->FaceCount()) && (!IsNewNeighbor())){
+        Advance();
+    }
+}
+
+
+VertexPtr Vertex::NeighborIterator::operator*() const {
+
+    return vertex_->face_[face_index_]->GetVertex(corner_index_);
+}
+
+
+bool Vertex::NeighborIterator::IsNewNeighbor(void) const {
+
+    // Check if the current vertex is a neighbor that has not been visited
+    // yet, by scanning the corners that come before it
+    VertexPtr candidate = **this;
+    if (candidate == vertex_){
+        return false;
+    }
+    FacePtr face = vertex_->face_[face_index_];
+    for (IdType k = 0; k < corner_index_; k++){
+        if (face->GetVertex(k) == candidate){
+            return false;
+        }
+    }
+    for (IdType j = 0; j < face_index_; j++){
+        FacePtr previous = vertex_->face_[j];
+        for (IdType k = 0; k < previous->VertexCount(); k++){
+            if (previous->GetVertex(k) == candidate){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+void Vertex::NeighborIterator::Advance(void){
+
+    // Move to the next corner of the faces around the vertex until a new
+    // neighbor or the end is found
+    IdType face_count = vertex_->face_.size();
+    while (face_index_ < face_count){
+        corner_index_++;
+        if (corner_index_ >= vertex_->face_[face_index_]->VertexCount()){
+            face_index_++;
+            corner_index_ = 0;
+            if (face_index_ >= face_count){
+                break;
+            }
+        }
+        if (IsNewNeighbor()){
+            break;
+        }
+    }
+}
+
+
+Vertex::NeighborIterator Vertex::NeighborBegin() {
+    return NeighborIterator(this, 0);
+}
+
+
+Vertex::NeighborIterator Vertex::NeighborEnd() {
+    return NeighborIterator(this, face_.size());
+}
+
+
 VertexResultContainer Vertex::GetNeighbors(void){
 
     // Result with the vertices in the one-ring
     VertexResultContainer result;
 
-    // Go through faces around this vertex
-    FaceInVertexContainer::iterator fit, fend;
-    fit = face_.begin();
-    fend = face_.end();
-    for (; fit != fend; fit++){
-        // Go through vertices in the current face
-        Face::VertexIterator vit, vend;
-        vit = (*fit)->VertexBegin();
-        vend = (*fit)->VertexEnd();
-        for (; vit != vend; vit++){
-            // If vertex is not itself
-            if ((*vit) != this){
-                // Add vertex to result
-                // The set makes sure that each element is only added once
-                result.insert(*vit);
-            }
-        }
+    // Go through the neighbors of this vertex
+    NeighborIterator nit, nend;
+    nit = NeighborBegin();
+    nend = NeighborEnd();
+    for (; nit != nend; nit++){
+        result.insert(*nit);
     }
 
     return result;
@@ -293,73 +438,109 @@ Face::VertexIterator Face::VertexEnd() {
 }
 
 
-bool ShareAnEdge(FacePtr face1, FacePtr face2){
+// Check if face contains the directed edge from vertex a to vertex b
+static bool HasDirectedEdge(FacePtr face, VertexPtr a, VertexPtr b){
 
-    // Check if the two faces share an edge
-
-    // Go through edges of face1
-    Face::VertexIterator vit1, vend1;
-    vit1 = face1->VertexBegin();
-    vend1 = face1->VertexEnd();
-    for (; vit1 != vend1; vit1++){
-        // Get two vertices that form the current edge of face1
-        VertexPtr v1a = *(vit1);
-        VertexPtr v1b = NULL;
-        if ((vit1 + 1) == vend1){
-            v1b = *(face1->VertexBegin());
-        } else {
-            v1b = *(vit1 + 1);
-        }
-        // Go through vertices of face2
-        Face::VertexIterator vit2, vend2;
-        vit2 = face2->VertexBegin();
-        vend2 = face2->VertexEnd();
-        for (; vit2 != vend2; vit2++){
-            // Get two vertices that form the current edge of face2
-            // Note that for face2 we need to traverse in clockwise
-            // order (the opposite order of face1), otherwise the
-            // extremities of the edges won't align with each other
-            VertexPtr v2a = NULL;
-            VertexPtr v2b = *(vit2);
-            if ((vit2 + 1) == vend2){
-                v2a = *(face2->VertexBegin());
-            } else {
-                v2a = *(vit2 + 1);
-            }
-            if ((v1a == v2a) && (v1b == v2b)){
-                return true;
-            }
+    IdType count = face->VertexCount();
+    for (IdType k = 0; k < count; k++){
+        if ((face->GetVertex(k) == a) && (face->GetVertex((k+1)%count) == b)){
+            return true;
         }
     }
-        
     return false;
 }
 
 
+Face::NeighborIterator::NeighborIterator(FacePtr face, IdType edge_index){
+
+    face_ = face;
+    edge_index_ = edge_index;
+    face_index_ = 0;
+
+    // Move to the first neighbor
+    if ((edge_index_ < face_->VertexCount()) &&
+        ((face_index_ >= face_->GetVertex(edge_index_)->FaceCount()) || (!IsNewNeighbor()))){
+        Advance();
+    }
+}
+
+
+FacePtr Face::NeighborIterator::operator*() const {
+
+    return face_->GetVertex(edge_index_)->GetFace(face_index_);
+}
+
+
+bool Face::NeighborIterator::IsNewNeighbor(void) const {
+
+    // A neighbor across edge k (from corner k to corner k+1) contains the
+    // same edge in the opposite direction, as in ShareAnEdge. Faces that
+    // also share an earlier edge have already been visited
+    FacePtr candidate = **this;
+    if (candidate == face_){
+        return false;
+    }
+    IdType count = face_->VertexCount();
+    VertexPtr a = face_->GetVertex(edge_index_);
+    VertexPtr b = face_->GetVertex((edge_index_+1)%count);
+    if (!HasDirectedEdge(candidate, b, a)){
+        return false;
+    }
+    for (IdType k = 0; k < edge_index_; k++){
+        if (HasDirectedEdge(candidate, face_->GetVertex((k+1)%count), face_->GetVertex(k))){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void Face::NeighborIterator::Advance(void){
+
+    // Move to the next face around the vertices of the face until a new
+    // neighbor or the end is found
+    IdType count = face_->VertexCount();
+    while (edge_index_ < count){
+        face_index_++;
+        if (face_index_ >= face_->GetVertex(edge_index_)->FaceCount()){
+            // Move to the faces around the next vertex
+            edge_index_++;
+            face_index_ = -1;
+            continue;
+        }
+        if (IsNewNeighbor()){
+            return;
+        }
+    }
+
+    // Reached the end
+    face_index_ = 0;
+}
+
+
+Face::NeighborIterator Face::NeighborBegin() {
+
+    return NeighborIterator(this, 0);
+}
+
+
+Face::NeighborIterator Face::NeighborEnd() {
+
+    return NeighborIterator(this, corner_.size());
+}
+
+
 FaceResultContainer Face::GetNeighbors(void){
 
     // Result with the neighboring faces
     FaceResultContainer result;
 
-    // Go through all the vertices in the face
-    VertexIterator vit, vend;
-    vit = VertexBegin();
-    vend = VertexEnd();
-    for (; vit != vend; vit++){
-        // Go through all faces in the current vertex
-        Vertex::FaceInVertexIterator fit, fend;
-        fit = (*vit)->FaceBegin();
-        fend = (*vit)->FaceEnd();
-        for (; fit != fend; fit++){
-            // If the face is not itself
-            if ((*fit) != this){
-                if (ShareAnEdge(*fit, this)){
-                    // Add face  to result
-                    // The set makes sure that each element is only added once
-                    result.insert(*fit);
-                }
-            }
-        }
+    // Go through the neighbors of this face
+    NeighborIterator nit, nend;
+    nit = NeighborBegin();
+    nend = NeighborEnd();
+    for (; nit != nend; nit++){
+        result.insert(*nit);
     }
 
     return result;
@@ -439,51 +620,166 @@ void Face::RemoveVertex(VertexPtr vertex){
 
 Mesh::Mesh(void){
 
+    geometry_cache_ = new MeshGeometryCache();
     last_vertex_id_ = -1;
     last_face_id_ = -1;
 
     has_connectivity_ = false;
+    has_vertex_face_table_ = false;
+    has_edge_table_ = false;
     has_vertex_normals_ = false;
     has_face_normals_ = false;
 
     color_scheme_ = NoColor;
+    Modified();
 }
 
 
 Mesh::Mesh(const Mesh &mesh){
 
-    // Copy basic variables
+    // Copy basic variables. The lengths and weights of the copied edge
+    // table are recomputed on first use, as the new cache starts dirty
+    geometry_cache_ = new MeshGeometryCache();
     has_connectivity_ = mesh.has_connectivity_;
+    has_vertex_face_table_ = mesh.has_vertex_face_table_;
+    has_edge_table_ = mesh.has_edge_table_;
     has_vertex_normals_ = mesh.has_vertex_normals_;
     has_face_normals_ = mesh.has_face_normals_;
     last_vertex_id_ = mesh.last_vertex_id_;
     last_face_id_ = mesh.last_face_id_;
     color_scheme_ = mesh.color_scheme_;
+    Modified();
+
+    // The tables only store ids, so they can be copied as they are
+    vertex_face_table_ = mesh.vertex_face_table_;
+    edge_table_ = mesh.edge_table_;
 
     // Copy all vertices and faces from one mesh to the other (deep copy)
 
-    // Copy all vertices from one mesh to the other while allocating new
-    // classes
-    VertexContainer::iterator vit, vend;
-    vit = vertex_.begin();
-    vend = vertex_.end();
+    // Gather the elements of the other mesh into arrays
+    std::vector<VertexPtr> old_vertex;
+    old_vertex.reserve(mesh.vertex_.size());
+    VertexContainer::const_iterator vit, vend;
+    vit = mesh.vertex_.begin();
+    vend = mesh.vertex_.end();
     for (; vit != vend; vit++){
-        VertexPtr vertex = new Vertex(*((*vit).second));
-        vertex_.insert(VertexContainer::value_type(vertex->id_, vertex));
+        old_vertex.push_back((*vit).second);
     }
- 
-    // Copy all faces from one mesh to the other
-    FaceContainer::iterator fit, fend;
-    fit = face_.begin();
-    fend = face_.end();
+    std::vector<FacePtr> old_face;
+    old_face.reserve(mesh.face_.size());
+    FaceContainer::const_iterator fit, fend;
+    fit = mesh.face_.begin();
+    fend = mesh.face_.end();
     for (; fit != fend; fit++){
-        FacePtr face = new Face(*((*fit).second));
-        face_.insert(FaceContainer::value_type(face->id_, face));
+        old_face.push_back((*fit).second);
     }
- 
-    // Fix connectivity references
-    ClearConnectivity();
-    ComputeConnectivity();
+
+    // Clone the elements in parallel, while recording the new element of
+    // each id
+    std::vector<VertexPtr> new_vertex(old_vertex.size());
+    std::vector<FacePtr> new_face(old_face.size());
+    std::vector<VertexPtr> vertex_by_id(last_vertex_id_ + 1, NULL);
+    std::vector<FacePtr> face_by_id(last_face_id_ + 1, NULL);
+    parallel_for(0, old_vertex.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            new_vertex[i] = new Vertex(*old_vertex[i]);
+            new_vertex[i]->geometry_cache_ = geometry_cache_;
+            vertex_by_id[new_vertex[i]->id_] = new_vertex[i];
+        }
+    });
+    parallel_for(0, old_face.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            new_face[i] = new Face(*old_face[i]);
+            face_by_id[new_face[i]->id_] = new_face[i];
+        }
+    });
+
+    // Add the elements to the containers. The elements are already sorted
+    // by id, so inserting at the end takes constant time
+    for (size_t i = 0; i < new_vertex.size(); i++){
+        vertex_.insert(vertex_.end(), VertexContainer::value_type(new_vertex[i]->id_, new_vertex[i]));
+    }
+    for (size_t i = 0; i < new_face.size(); i++){
+        face_.insert(face_.end(), FaceContainer::value_type(new_face[i]->id_, new_face[i]));
+    }
+
+    // Remap the pointers of the cloned elements in one pass
+    parallel_for(0, new_vertex.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            FaceInVertexContainer &faces = new_vertex[i]->face_;
+            for (size_t j = 0; j < faces.size(); j++){
+                faces[j] = face_by_id[faces[j]->id_];
+            }
+        }
+    });
+    parallel_for(0, new_face.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            CornerContainer &corners = new_face[i]->corner_;
+            for (size_t j = 0; j < corners.size(); j++){
+                corners[j].vertex_ = vertex_by_id[corners[j].vertex_->id_];
+            }
+        }
+    });
+}
+
+
+Mesh::Mesh(Mesh &&mesh) : Mesh() {
+
+    // Take the contents of the other mesh, which is left empty
+    Swap(mesh);
+}
+
+
+Mesh &Mesh::operator=(const Mesh &mesh){
+
+    // Copy and swap, so that the previous contents are released by the
+    // temporary
+    if (this != &mesh){
+        Mesh temp(mesh);
+        Swap(temp);
+    }
+    return *this;
+}
+
+
+Mesh &Mesh::operator=(Mesh &&mesh){
+
+    // The previous contents are left in the other mesh, which releases
+    // them when destroyed
+    Swap(mesh);
+    return *this;
+}
+
+
+void Mesh::Swap(Mesh &mesh){
+
+    // Exchange the contents of the two meshes. Only the containers are
+    // exchanged, so the elements themselves are not touched
+    vertex_.swap(mesh.vertex_);
+    face_.swap(mesh.face_);
+    std::swap(vertex_face_table_, mesh.vertex_face_table_);
+    std::swap(edge_table_, mesh.edge_table_);
+    std::swap(has_connectivity_, mesh.has_connectivity_);
+    std::swap(has_vertex_face_table_, mesh.has_vertex_face_table_);
+    std::swap(has_edge_table_, mesh.has_edge_table_);
+    std::swap(has_vertex_normals_, mesh.has_vertex_normals_);
+    std::swap(has_face_normals_, mesh.has_face_normals_);
+    std::swap(last_vertex_id_, mesh.last_vertex_id_);
+    std::swap(last_face_id_, mesh.last_face_id_);
+    std::swap(color_scheme_, mesh.color_scheme_);
+    std::swap(geometry_cache_, mesh.geometry_cache_);
+}
+
+
+unsigned long long Mesh::Version(void) const {
+
+    return geometry_cache_->version.load(std::memory_order_acquire);
+}
+
+
+void Mesh::Modified(void){
+
+    geometry_cache_->Modified();
 }
 
 
@@ -494,17 +790,14 @@ void Mesh::DeletePointers(void){
     vit = vertex_.begin();
     vend = vertex_.end();
     for (; vit != vend; vit++){
-        VertexPtr vertex = new Vertex(*((*vit).second));
-        delete vertex;
+        delete (*vit).second;
     }
  
-    // Copy all faces from one mesh to the other
     FaceContainer::iterator fit, fend;
     fit = face_.begin();
     fend = face_.end();
     for (; fit != fend; fit++){
-        FacePtr face = new Face(*((*fit).second));
-        delete face;
+        delete (*fit).second;
     }
 }
 
@@ -514,6 +807,7 @@ Mesh::~Mesh(){
     // Remove all vertices and faces that we allocated manually
     // All the rest is taken care by the destructors of the subclasses
     DeletePointers();
+    delete geometry_cache_;
 }
 
 
@@ -528,11 +822,16 @@ void Mesh::Clear(void){
     last_vertex_id_ = -1;
     last_face_id_ = -1;
 
+    vertex_face_table_ = VertexFaceTable();
+    edge_table_ = EdgeTable();
     has_connectivity_ = false;
+    has_vertex_face_table_ = false;
+    has_edge_table_ = false;
     has_vertex_normals_ = false;
     has_face_normals_ = false;
 
     color_scheme_ = NoColor;
+    Modified();
 }
 
 
@@ -548,113 +847,400 @@ void Mesh::ClearConnectivity(void){
         vertex->face_.clear();
     }
 
-    // Set flag
+    // Release the vertex-to-face table
+    vertex_face_table_ = VertexFaceTable();
+
+    // Set flags
     has_connectivity_ = false;
+    has_vertex_face_table_ = false;
 }
 
 
-void Mesh::ComputeConnectivity(void){
+void Mesh::ComputeVertexFaceTable(void){
 
-    // Check flag
-    if (has_connectivity_){
-        ClearConnectivity();
-    }
+    // Build the vertex-to-face table with a counting sort: count the
+    // faces of each vertex, prefix-sum the counts into offsets, and
+    // scatter the face ids into the flat array. Counting and scattering
+    // are done in parallel over the faces
 
-    // Compute connectivity
-    // Loop through all faces in the mesh
+    // Gather the faces into an array so that they can be split among
+    // threads
+    std::vector<FacePtr> faces;
+    faces.reserve(face_.size());
     FaceContainer::iterator fit, fend;
     fit = face_.begin();
     fend = face_.end();
     for (; fit != fend; fit++){
-        FacePtr face = (*fit).second;
-        // Loop through all vertices of this face
-        CornerContainer::iterator cit, cend;
-        cit = face->corner_.begin();
-        cend = face->corner_.end();
-        for (; cit != cend; cit++){
-            // Add face to the list of faces of the vertex
-            (*cit).vertex_->AddFace(face);
+        faces.push_back((*fit).second);
+    }
+
+    // Count faces per vertex. Count of vertex v is stored in entry v+1,
+    // so that the prefix sum directly yields the offsets
+    IdType table_size = last_vertex_id_ + 1;
+    std::vector<std::atomic<IdType> > count(table_size + 1);
+    parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            CornerContainer::iterator cit, cend;
+            cit = faces[i]->corner_.begin();
+            cend = faces[i]->corner_.end();
+            for (; cit != cend; cit++){
+                count[(*cit).vertex_->id_ + 1].fetch_add(1, std::memory_order_relaxed);
+            }
         }
+    });
+
+    // Prefix sum of the counts
+    VertexFaceTable &table = vertex_face_table_;
+    table.offset.resize(table_size + 1);
+    table.offset[0] = 0;
+    for (IdType v = 0; v < table_size; v++){
+        table.offset[v+1] = table.offset[v] + count[v+1].load(std::memory_order_relaxed);
     }
 
+    // Scatter face ids, using the counts as insertion cursors
+    for (IdType v = 0; v < table_size; v++){
+        count[v].store(table.offset[v], std::memory_order_relaxed);
+    }
+    table.face.resize(table.offset[table_size]);
+    parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            CornerContainer::iterator cit, cend;
+            cit = faces[i]->corner_.begin();
+            cend = faces[i]->corner_.end();
+            for (; cit != cend; cit++){
+                IdType pos = count[(*cit).vertex_->id_].fetch_add(1, std::memory_order_relaxed);
+                table.face[pos] = faces[i]->id_;
+            }
+        }
+    });
+
+    // The parallel scatter does not preserve the order of the faces, so
+    // sort the faces of each vertex by id. The result is the same as
+    // inserting the faces serially in the order of the face container
+    parallel_for(0, table_size, [&](size_t begin, size_t end){
+        for (size_t v = begin; v < end; v++){
+            std::sort(table.face.begin() + table.offset[v], table.face.begin() + table.offset[v+1]);
+        }
+    });
+
     // Set flag
-    has_connectivity_ = true;
+    has_vertex_face_table_ = true;
 }
 
 
-void Mesh::NormalizePositions(float target_min, float target_max){
+void Mesh::ComputeConnectivity(void){
 
-    // Normalize the vertex coordinates of a mesh into a cube with
-    // coordinates (target_min, target_max) along each dimension, while
-    // preserving the aspect ratio of the shape
-    //
-    // For each coordinate x, y, and z, we obtain a range of values to
-    // map, where the range for coordinate i is given by range_i = max_i
-    // - min_i, where max_i is the maximum value for coordinate i for
-    // all points, and min_i is defined analogously. Then, we would like
-    // to map the coordinate with the largest range range_max to
-    // (target_min, target_max), and map the other coordinates i by
-    // keeping the proportion of range_i to range_max, so that the
-    // aspect ratio of the shape is maintained.
-    //
-    // Thus, we would like to map a specific range_i from (max_i -
-    // min_i) to (target_min*p, target_max*p), where p is the proportion
-    // of range_i to the largest range, given by range_i/range_max. This
-    // mapping is illustrated with the following diagram, where r is the
-    // resulting mapped value:
-    //
-    // min_i     target_min*p        
-    //   |        |
-    // coord_i    r         
-    //   |        |
-    // max_i      target_max*p       
-    //
-    // This mapping problem gives the following ratio equality:
-    //
-    // coord_i - min_i    r -target_min*p
-    // ---------------  = ------------
-    // max_i - min_i      (target_max - target_min)*p
-    //
-    // By multiplying the fractions, and plugging in the definition of
-    // p, we get the equation:
-    //
-    //     coord_i*(target_max - target_min) -min_i*target_max + max_i*target_min
-    // r = ----------------------------------------------------------------------
-    //                                 (max - min)
+    // Check flag
+    if (has_connectivity_){
+        ClearConnectivity();
+    }
 
-    // Get min and max coordinates of all vertices
+    // Compute the vertex-to-face table in bulk
+    ComputeVertexFaceTable();
+
+    // Copy the faces of each vertex from the table into the vertex
+    AssignVertexFacesFromTable();
+
+    // Set flag
+    has_connectivity_ = true;
+}
+
+
+void Mesh::AssignVertexFacesFromTable(void){
+
+    // Dense lookup tables from ids to elements
+    std::vector<VertexPtr> vertices;
+    vertices.reserve(vertex_.size());
     VertexContainer::iterator vit, vend;
     vit = vertex_.begin();
     vend = vertex_.end();
-    VertexPtr v = (*vit).second;
-    glm::vec3 min_pos = v->position_;
-    glm::vec3 max_pos = v->position_;
-    vit++;
     for (; vit != vend; vit++){
-        v = (*vit).second;
-        for (int i = 0; i < 3; i++){
-            if (v->position_[i] < min_pos[i]){
-                min_pos[i] = v->position_[i];
-            }
-            if (v->position_[i] > max_pos[i]){
-                max_pos[i] = v->position_[i];
+        vertices.push_back((*vit).second);
+    }
+    std::vector<FacePtr> face_by_id(last_face_id_ + 1, NULL);
+    FaceContainer::iterator fit, fend;
+    fit = face_.begin();
+    fend = face_.end();
+    for (; fit != fend; fit++){
+        face_by_id[(*fit).first] = (*fit).second;
+    }
+
+    // Copy the faces of each vertex from the table into the vertex. Each
+    // list is allocated once with its final size
+    const VertexFaceTable &table = vertex_face_table_;
+    parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            VertexPtr vertex = vertices[i];
+            IdType first = table.offset[vertex->id_];
+            IdType last = table.offset[vertex->id_ + 1];
+            vertex->face_.resize(last - first);
+            for (IdType j = first; j < last; j++){
+                vertex->face_[j - first] = face_by_id[table.face[j]];
             }
         }
+    });
+}
+
+
+const VertexFaceTable &Mesh::GetVertexFaceTable(void){
+
+    // Build the table if it is missing or out of date
+    if (!has_vertex_face_table_){
+        ComputeVertexFaceTable();
     }
 
-    // Compute constants used for mapping
-    glm::vec3 diff = max_pos - min_pos;
-    float range = glm::max(diff[0], glm::max(diff[1], diff[2]));
-    float mult_const = target_max - target_min;
-    glm::vec3 add_const = -min_pos*target_max + max_pos*target_min;
+    return vertex_face_table_;
+}
 
-    // Map vertex coordinates to new range
+
+void Mesh::TopologyChanged(void){
+
+    // Tables derived from the topology need to be recomputed
+    has_vertex_face_table_ = false;
+    has_edge_table_ = false;
+    Modified();
+}
+
+
+void Mesh::GetElementArrays(std::vector<VertexPtr> &vertices, std::vector<FacePtr> &faces){
+
+    vertices.clear();
+    vertices.reserve(vertex_.size());
+    VertexContainer::iterator vit, vend;
+    vit = vertex_.begin();
+    vend = vertex_.end();
+    for (; vit != vend; vit++){
+        vertices.push_back((*vit).second);
+    }
+    faces.clear();
+    faces.reserve(face_.size());
+    FaceContainer::iterator fit, fend;
+    fit = face_.begin();
+    fend = face_.end();
+    for (; fit != fend; fit++){
+        faces.push_back((*fit).second);
+    }
+}
+
+
+// Half-edge record used to sort the edges of all faces
+struct EdgeKey {
+    unsigned long long key;
+    IdType slot;
+    bool operator<(const EdgeKey &other) const {
+        return (key < other.key) || ((key == other.key) && (slot < other.slot));
+    }
+};
+
+
+// Cotangent of the angle at corner c of the triangle (a, b, c)
+static float CotangentAt(const PositionType &a, const PositionType &b, const PositionType &c){
+
+    glm::vec3 u = a - c;
+    glm::vec3 v = b - c;
+    float len = glm::length(glm::cross(u, v));
+    if (len <= 0.0){
+        return 0.0;
+    }
+    return glm::dot(u, v)/len;
+}
+
+
+void Mesh::ComputeEdgeTable(void){
+
+    // Gather the faces into an array so that they can be split among
+    // threads
+    std::vector<FacePtr> faces;
+    faces.reserve(face_.size());
+    FaceContainer::iterator fit, fend;
+    fit = face_.begin();
+    fend = face_.end();
+    for (; fit != fend; fit++){
+        faces.push_back((*fit).second);
+    }
+
+    // Create one key per edge of each face, where the key is formed by
+    // the two vertex ids in increasing order, and sort the keys so that
+    // copies of the same edge become adjacent
+    std::vector<EdgeKey> key(faces.size()*3);
+    parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            for (int k = 0; k < 3; k++){
+                unsigned long long v0 = faces[i]->corner_[k].vertex_->id_;
+                unsigned long long v1 = faces[i]->corner_[(k+1)%3].vertex_->id_;
+                if (v0 > v1){
+                    std::swap(v0, v1);
+                }
+                key[i*3 + k].key = (v0 << 32) | v1;
+                key[i*3 + k].slot = i*3 + k;
+            }
+        }
+    });
+    parallel_sort(key.begin(), key.end(), std::less<EdgeKey>());
+
+    // Assign an id to each unique key and link edges and faces
+    EdgeTable &table = edge_table_;
+    table.edge.clear();
+    table.face_edge.assign((last_face_id_ + 1)*3, -1);
+    for (size_t i = 0; i < key.size(); i++){
+        IdType face_id = faces[key[i].slot/3]->id_;
+        if ((i == 0) || (key[i].key != key[i-1].key)){
+            Edge edge;
+            edge.vertex[0] = key[i].key >> 32;
+            edge.vertex[1] = key[i].key & 0xFFFFFFFF;
+            edge.face[0] = face_id;
+            edge.face[1] = -1;
+            edge.face_count = 1;
+            table.edge.push_back(edge);
+        } else {
+            Edge &edge = table.edge.back();
+            if (edge.face_count == 1){
+                edge.face[1] = face_id;
+            }
+            edge.face_count++;
+        }
+        table.face_edge[face_id*3 + key[i].slot%3] = table.edge.size()-1;
+    }
+
+    // Compute edge attributes
+    ComputeEdgeGeometry(faces);
+
+    // Set flag
+    has_edge_table_ = true;
+}
+
+
+void Mesh::ComputeEdgeGeometry(const std::vector<FacePtr> &faces){
+
+    // Compute the length of each edge of the faces and the cotangent of
+    // the angle opposite to it in parallel
+    EdgeTable &table = edge_table_;
+    std::vector<float> slot_length(faces.size()*3);
+    std::vector<float> slot_cot(faces.size()*3);
+    parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            const CornerContainer &corners = faces[i]->corner_;
+            for (int k = 0; k < 3; k++){
+                const PositionType &p0 = corners[k].vertex_->position_;
+                const PositionType &p1 = corners[(k+1)%3].vertex_->position_;
+                slot_length[i*3 + k] = glm::distance(p0, p1);
+                slot_cot[i*3 + k] = CotangentAt(p0, p1, corners[(k+2)%3].vertex_->position_);
+            }
+        }
+    });
+
+    // Gather them into the edges in face order. The cotangents are added
+    // over all the faces of the edge, including the ones after the first
+    // two of non-manifold edges
+    table.length.assign(table.edge.size(), 0.0);
+    table.cot_weight.assign(table.edge.size(), 0.0);
+    for (size_t i = 0; i < faces.size(); i++){
+        const IdType *face_edge = &table.face_edge[faces[i]->id_*3];
+        for (int k = 0; k < 3; k++){
+            table.length[face_edge[k]] = slot_length[i*3 + k];
+            table.cot_weight[face_edge[k]] += slot_cot[i*3 + k];
+        }
+    }
+    for (size_t e = 0; e < table.cot_weight.size(); e++){
+        table.cot_weight[e] /= 2.0;
+    }
+}
+
+
+const EdgeTable &Mesh::GetEdgeTable(void){
+
+    // Build the table if it is missing, and update its lengths and weights
+    // if the positions changed since they were computed
+    MeshGeometryCache &cache = *geometry_cache_;
+    cache.Update(MeshGeometryCache::EdgeGeometry, [&](){
+        if (has_edge_table_){
+            std::vector<VertexPtr> vertices;
+            std::vector<FacePtr> faces;
+            GetElementArrays(vertices, faces);
+            ComputeEdgeGeometry(faces);
+        } else {
+            ComputeEdgeTable();
+        }
+    });
+
+    return edge_table_;
+}
+
+
+void Mesh::NormalizePositions(float target_min, float target_max){
+
+    // Normalize the vertex coordinates of a mesh into a cube with
+    // coordinates (target_min, target_max) along each dimension, while
+    // preserving the aspect ratio of the shape
+    //
+    // For each coordinate x, y, and z, we obtain a range of values to
+    // map, where the range for coordinate i is given by range_i = max_i
+    // - min_i, where max_i is the maximum value for coordinate i for
+    // all points, and min_i is defined analogously. Then, we would like
+    // to map the coordinate with the largest range range_max to
+    // (target_min, target_max), and map the other coordinates i by
+    // keeping the proportion of range_i to range_max, so that the
+    // aspect ratio of the shape is maintained.
+    //
+    // Thus, we would like to map a specific range_i from (max_i -
+    // min_i) to (target_min*p, target_max*p), where p is the proportion
+    // of range_i to the largest range, given by range_i/range_max. This
+    // mapping is illustrated with the following diagram, where r is the
+    // resulting mapped value:
+    //
+    // min_i     target_min*p        
+    //   |        |
+    // coord_i    r         
+    //   |        |
+    // max_i      target_max*p       
+    //
+    // This mapping problem gives the following ratio equality:
+    //
+    // coord_i - min_i    r -target_min*p
+    // ---------------  = ------------
+    // max_i - min_i      (target_max - target_min)*p
+    //
+    // By multiplying the fractions, and plugging in the definition of
+    // p, we get the equation:
+    //
+    //     coord_i*(target_max - target_min) -min_i*target_max + max_i*target_min
+    // r = ----------------------------------------------------------------------
+    //                                 (max - min)
+
+    // Get min and max coordinates of all vertices
+    VertexContainer::iterator vit, vend;
+    vit = vertex_.begin();
+    vend = vertex_.end();
+    VertexPtr v = (*vit).second;
+    glm::vec3 min_pos = v->position_;
+    glm::vec3 max_pos = v->position_;
+    vit++;
+    for (; vit != vend; vit++){
+        v = (*vit).second;
+        for (int i = 0; i < 3; i++){
+            if (v->position_[i] < min_pos[i]){
+                min_pos[i] = v->position_[i];
+            }
+            if (v->position_[i] > max_pos[i]){
+                max_pos[i] = v->position_[i];
+            }
+        }
+    }
+
+    // Compute constants used for mapping
+    glm::vec3 diff = max_pos - min_pos;
+    float range = glm::max(diff[0], glm::max(diff[1], diff[2]));
+    float mult_const = target_max - target_min;
+    glm::vec3 add_const = -min_pos*target_max + max_pos*target_min;
+
+    // Map vertex coordinates to new range
     vit = vertex_.begin();
     vend = vertex_.end();
     for (; vit != vend; vit++){
         v = (*vit).second;
         v->position_ = (v->position_*mult_const + add_const)/range;
     }
+    Modified();
 }
 
 
@@ -763,6 +1349,115 @@ void Mesh::ManuallyAssignFaceNormals(void){
 }
 
 
+const std::vector<PositionType> &Mesh::GetFaceCentroids(void){
+
+    MeshGeometryCache &cache = *geometry_cache_;
+    cache.Update(MeshGeometryCache::FaceCentroids, [&](){
+        std::vector<VertexPtr> vertices;
+        std::vector<FacePtr> faces;
+        GetElementArrays(vertices, faces);
+        cache.face_centroid.assign(last_face_id_ + 1, PositionType(0.0, 0.0, 0.0));
+        parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; i++){
+                cache.face_centroid[faces[i]->id_] = faces[i]->GetCentroid();
+            }
+        });
+    });
+    return cache.face_centroid;
+}
+
+
+const std::vector<AreaType> &Mesh::GetFaceAreas(void){
+
+    MeshGeometryCache &cache = *geometry_cache_;
+    cache.Update(MeshGeometryCache::FaceAreas, [&](){
+        std::vector<VertexPtr> vertices;
+        std::vector<FacePtr> faces;
+        GetElementArrays(vertices, faces);
+        cache.face_area.assign(last_face_id_ + 1, 0.0);
+        parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; i++){
+                // Same area as computed with the face normals
+                const CornerContainer &corners = faces[i]->corner_;
+                glm::vec3 vec0 = corners[1].vertex_->position_ - corners[0].vertex_->position_;
+                glm::vec3 vec1 = corners[2].vertex_->position_ - corners[0].vertex_->position_;
+                cache.face_area[faces[i]->id_] = glm::length(glm::cross(vec0, vec1))/2.0;
+            }
+        });
+    });
+    return cache.face_area;
+}
+
+
+const std::vector<AreaType> &Mesh::GetVertexAreas(void){
+
+    // The face areas are updated first, as they use the same lock
+    const std::vector<AreaType> &face_area = GetFaceAreas();
+
+    MeshGeometryCache &cache = *geometry_cache_;
+    cache.Update(MeshGeometryCache::VertexAreas, [&](){
+        std::vector<VertexPtr> vertices;
+        std::vector<FacePtr> faces;
+        GetElementArrays(vertices, faces);
+        cache.vertex_area.assign(last_vertex_id_ + 1, 0.0);
+        if (has_connectivity_){
+            // Gather the areas of the faces of each vertex in parallel
+            parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+                for (size_t i = begin; i < end; i++){
+                    AreaType area = 0.0;
+                    const FaceInVertexContainer &vertex_faces = vertices[i]->face_;
+                    for (size_t j = 0; j < vertex_faces.size(); j++){
+                        area += face_area[vertex_faces[j]->id_];
+                    }
+                    cache.vertex_area[vertices[i]->id_] = area/3.0f;
+                }
+            });
+        } else {
+            // Without connectivity, the area of each face is added to its
+            // vertices
+            for (size_t i = 0; i < faces.size(); i++){
+                AreaType area = face_area[faces[i]->id_]/3.0f;
+                for (int k = 0; k < 3; k++){
+                    cache.vertex_area[faces[i]->corner_[k].vertex_->id_] += area;
+                }
+            }
+        }
+    });
+    return cache.vertex_area;
+}
+
+
+void Mesh::GetBoundingBox(PositionType &min, PositionType &max){
+
+    MeshGeometryCache &cache = *geometry_cache_;
+    cache.Update(MeshGeometryCache::BoundingBox, [&](){
+        std::vector<VertexPtr> vertices;
+        std::vector<FacePtr> faces;
+        GetElementArrays(vertices, faces);
+        if (vertices.empty()){
+            cache.box_min = cache.box_max = PositionType(0.0, 0.0, 0.0);
+            return;
+        }
+        // Box of each block, then of the whole mesh
+        std::mutex box_mutex;
+        cache.box_min = cache.box_max = vertices[0]->position_;
+        parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+            PositionType block_min = vertices[begin]->position_;
+            PositionType block_max = block_min;
+            for (size_t i = begin; i < end; i++){
+                block_min = glm::min(block_min, vertices[i]->position_);
+                block_max = glm::max(block_max, vertices[i]->position_);
+            }
+            std::lock_guard<std::mutex> lock(box_mutex);
+            cache.box_min = glm::min(cache.box_min, block_min);
+            cache.box_max = glm::max(cache.box_max, block_max);
+        });
+    });
+    min = cache.box_min;
+    max = cache.box_max;
+}
+
+
 void Mesh::CopyCornerAttributesToVertices(void){
 
     // Loop through all faces in the mesh
@@ -851,201 +1546,119 @@ void Mesh::CopyVertexAttributesToCorners(void){
 }
 
 
-void Mesh::Read(const char *filename){
+// Get the attributes requested by the read options
+static int read_attributes(const Mesh::ReadOptions &options){
+
+    return (options.read_colors ? AttributeColor : 0) |
+           (options.read_normals ? AttributeNormal : 0) |
+           (options.read_uvs ? AttributeUV : 0);
+}
+
+
+void Mesh::Read(const char *filename, const ReadOptions &options){
 
     std::string fn = std::string(filename); 
-    std::string ext = get_extension(fn);
+    std::string ext = mesh_extension(fn);
     if ((ext == std::string("obj")) ||
         (ext == std::string("OBJ"))){
-        ReadObj(filename);
+        ReadObj(filename, options);
     } else if ((ext == std::string("off")) ||
                (ext == std::string("OFF"))){
         ReadOff(filename);
+    } else if ((ext == std::string("gpm")) ||
+               (ext == std::string("GPM"))){
+        ReadBinary(filename, options);
+    } else if ((ext == std::string("ply")) ||
+               (ext == std::string("PLY"))){
+        ReadPly(filename, options);
+    } else if ((ext == std::string("stl")) ||
+               (ext == std::string("STL"))){
+        ReadStl(filename, options);
     } else {
         throw(std::ios_base::failure(std::string("Error: extension \"")+ext+std::string("\" not supported")));
     }
 }
 
 
-void Mesh::ReadObj(const char *filename){
-
-    // Open file and check for errors
-    std::ifstream f;
-    f.open(filename);
-    if (f.fail()){
-        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
-    }
+void Mesh::ReadObj(const char *filename, const ReadOptions &options){
 
     // Parse file
-    // Empty space that can be trimmed from the beginning and end of lines
-    std::string ignore(" \t\r\n");
-    // Parameter separators in commands (lines)
-    std::string part_separator(" \t");
-    // Separator of face attributes
-    std::string att_separator("/");
-
     // Since a face in the obj format references lists of vertices,
     // normals, and texture coordinates, we first need to store these
-    // lits to allow for proper indexing
-
-    // Temporary holder for faces
-    std::vector<TempFace> faces;
-    // Temporary holder for normals
-    std::vector<NormalType> normals;
-    // Temporary holder for uvs
-    std::vector<UVType> uvs;
-
-    // Go through each line of the file
-    std::string line;
-    while (std::getline(f, line)){
-        // Trim whitespace from the extremities of the string
-        string_trim(line, ignore);
-        // Ignore lines that are comments
-        if ((line.size() <= 0) ||
-            (line[0] == '#')){
-            continue;
-        }
-        // Parse string
-        std::vector<std::string> part = string_split(line, part_separator);
-        // Check command in the string
-        if (!part[0].compare(std::string("v"))){
-            if (part.size() == 4){
-                PositionType position(str_to_num<float>(part[1].c_str()), str_to_num<float>(part[2].c_str()), str_to_num<float>(part[3].c_str()));
-                AddVertex(position);
-            } else if (part.size() == 7){
-                glm::vec3 position(str_to_num<float>(part[1].c_str()), str_to_num<float>(part[2].c_str()), str_to_num<float>(part[3].c_str()));
-                glm::vec3 color(str_to_num<float>(part[4].c_str()), str_to_num<float>(part[5].c_str()), str_to_num<float>(part[6].c_str()));
-                VertexPtr vertex = AddVertex(position);
-                vertex->SetColor(color);
+    // lits to allow for proper indexing. The text is split into chunks
+    // of whole lines that are parsed in place and in parallel
+    std::vector<ObjChunk> chunk;
+    if (file_compression(filename) != NoCompression){
+        // Parse compressed files while they are decoded by another thread
+        InputStream stream;
+        stream.Open(filename);
+        parse_obj_stream(stream, chunk, read_attributes(options));
+    } else {
+        // Map file into memory
+        MappedFile file;
+        file.Open(filename);
+        parse_obj_chunks(file.Data(), file.Data() + file.Size(), chunk, read_attributes(options));
+    }
+
+    // Concatenate the normals and uvs of all chunks, since faces can
+    // reference the elements of any chunk
+    std::vector<NormalType> &normals = chunk[0].normal;
+    std::vector<UVType> &uvs = chunk[0].uv;
+    for (unsigned int c = 1; c < chunk.size(); c++){
+        normals.insert(normals.end(), chunk[c].normal.begin(), chunk[c].normal.end());
+        uvs.insert(uvs.end(), chunk[c].uv.begin(), chunk[c].uv.end());
+    }
+
+    // Create vertices
+    std::vector<VertexPtr> vertices;
+    for (unsigned int c = 0; c < chunk.size(); c++){
+        for (unsigned int i = 0; i < chunk[c].position.size(); i++){
+            VertexPtr vertex = AddVertex(chunk[c].position[i]);
+            if (chunk[c].color.size() > 0){
+                vertex->SetColor(chunk[c].color[i]);
                 color_scheme_ = VertexColor;
-            } else {
-                throw(std::ios_base::failure(std::string("Error: v command should have exactly 3 or 6 parameters")));
-            }
-        } else if (!part[0].compare(std::string("vn"))){
-            if (part.size() == 4){
-                glm::vec3 normal(str_to_num<float>(part[1].c_str()), str_to_num<float>(part[2].c_str()), str_to_num<float>(part[3].c_str()));
-                normals.push_back(normal);
-            } else {
-                throw(std::ios_base::failure(std::string("Error: vn command should have exactly 3 parameters")));
-            }
-        } else if (!part[0].compare(std::string("vt"))){
-            if (part.size() == 3){
-                glm::vec2 tex_coord(str_to_num<float>(part[1].c_str()), str_to_num<float>(part[2].c_str()));
-                uvs.push_back(tex_coord);
-            } else {
-                throw(std::ios_base::failure(std::string("Error: vt command should have exactly 2 parameters")));
-            }
-        } else if (!part[0].compare(std::string("f"))){
-            if (part.size() >= 4){
-                if (part.size() > 5){
-                    throw(std::ios_base::failure(std::string("Error: f commands with more than 4 vertices not supported")));
-                } else if (part.size() == 5){
-                    // Read a quad
-                    TempQuad quad;
-                    for (int i = 0; i < 4; i++){
-                        std::vector<std::string> fd = string_split_one_sep(part[i+1], att_separator);
-                        if (fd.size() == 1){
-                            quad.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            quad.t[i] = -1;
-                            quad.n[i] = -1;
-                        } else if (fd.size() == 2){
-                            quad.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            quad.t[i] = str_to_num<float>(fd[1].c_str())-1;
-                            quad.n[i] = -1;
-                        } else if (fd.size() == 3){
-                            quad.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            if (std::string("").compare(fd[1]) != 0){
-                                quad.t[i] = str_to_num<float>(fd[1].c_str())-1;
-                            } else {
-                                quad.t[i] = -1;
-                            }
-                            quad.n[i] = str_to_num<float>(fd[2].c_str())-1;
-                        } else {
-                            throw(std::ios_base::failure(std::string("Error: f parameter should have 1 or 3 parameters separated by '/'")));
-                        }
-                    }
-                    // Break the quad into two triangles
-                    TempFace face1, face2;
-                    face1.i[0] = quad.i[0]; face1.i[1] = quad.i[1]; face1.i[2] = quad.i[2];
-                    face1.n[0] = quad.n[0]; face1.n[1] = quad.n[1]; face1.n[2] = quad.n[2];
-                    face1.t[0] = quad.t[0]; face1.t[1] = quad.t[1]; face1.t[2] = quad.t[2];
-                    face2.i[0] = quad.i[0]; face2.i[1] = quad.i[2]; face2.i[2] = quad.i[3];
-                    face2.n[0] = quad.n[0]; face2.n[1] = quad.n[2]; face2.n[2] = quad.n[3];
-                    face2.t[0] = quad.t[0]; face2.t[1] = quad.t[2]; face2.t[2] = quad.t[3];
-                    // Add triangles to temporary list
-                    faces.push_back(face1);
-                    faces.push_back(face2);
-                } else if (part.size() == 4){
-                    // Read a triangle
-                    TempFace face;
-                    for (int i = 0; i < 3; i++){
-                        std::vector<std::string> fd = string_split_one_sep(part[i+1], att_separator);
-                        if (fd.size() == 1){
-                            face.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            face.t[i] = -1;
-                            face.n[i] = -1;
-                        } else if (fd.size() == 2){
-                            face.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            face.t[i] = str_to_num<float>(fd[1].c_str())-1;
-                            face.n[i] = -1;
-                        } else if (fd.size() == 3){
-                            face.i[i] = str_to_num<float>(fd[0].c_str())-1;
-                            if (std::string("").compare(fd[1]) != 0){
-                                face.t[i] = str_to_num<float>(fd[1].c_str())-1;
-                            } else {
-                                face.t[i] = -1;
-                            }
-                            face.n[i] = str_to_num<float>(fd[2].c_str())-1;
-                        } else {
-                            throw(std::ios_base::failure(std::string("Error: f parameter should have 1, 2, or 3 parameters separated by '/'")));
-                        }
-                    }
-                    // Add triangle to temporary list
-                    faces.push_back(face);
-                }
-            } else {
-                throw(std::ios_base::failure(std::string("Error: f command should have 3 or 4 parameters")));
             }
+            vertices.push_back(vertex);
         }
-        // Ignore other commands
     }
 
-    // Close file
-    f.close();
-
     // Create faces from temporary faces and copy attributes
-    for (unsigned int i = 0; i < faces.size(); i++){
-        // Check if vertex references in face are correct
-        for (int j = 0; j < 3; j++){
-            if (faces[i].i[j] >= VertexCount()){
-                throw(std::ios_base::failure(std::string("Error: index for triangle ")+num_to_str<int>(faces[i].i[j])+std::string(" is out of bounds")));
+    int findex = 0;
+    for (unsigned int c = 0; c < chunk.size(); c++){
+        std::vector<TempFace> &faces = chunk[c].face;
+        for (unsigned int i = 0; i < faces.size(); i++, findex++){
+            // Check if vertex references in face are correct
+            for (int j = 0; j < 3; j++){
+                if ((faces[i].i[j] < 0) || (faces[i].i[j] >= (int) vertices.size())){
+                    throw(std::ios_base::failure(std::string("Error: index for triangle ")+num_to_str<int>(faces[i].i[j])+std::string(" is out of bounds")));
+                }
             }
-        }
-        // Add face
-        FacePtr face = AddFace(faces[i].i[0], faces[i].i[1], faces[i].i[2]);
-        // Add normals
-        if (normals.size() > 0){
-            Face::CornerIterator cit, cend;
-            cit = face->CornerBegin();
-            cend = face->CornerEnd();
-            for (int j = 0; cit != cend; cit++, j++){
-                if (faces[i].n[j] >= normals.size()){
-                    throw(std::ios_base::failure(std::string("Error: index for normal ")+num_to_str<int>(faces[i].n[j])+std::string(" in face ")+num_to_str<int>(i)+std::string(" is out of bounds")));
-                } else {
-                    (*cit)->SetNormal(normals[faces[i].n[j]]);
+            // Add face
+            FacePtr face = AddFace(vertices[faces[i].i[0]], vertices[faces[i].i[1]], vertices[faces[i].i[2]]);
+            // Add normals
+            if (normals.size() > 0){
+                Face::CornerIterator cit, cend;
+                cit = face->CornerBegin();
+                cend = face->CornerEnd();
+                for (int j = 0; cit != cend; cit++, j++){
+                    if ((faces[i].n[j] < 0) || (faces[i].n[j] >= (int) normals.size())){
+                        throw(std::ios_base::failure(std::string("Error: index for normal ")+num_to_str<int>(faces[i].n[j])+std::string(" in face ")+num_to_str<int>(findex)+std::string(" is out of bounds")));
+                    } else {
+                        (*cit)->SetNormal(normals[faces[i].n[j]]);
+                    }
                 }
             }
-        }
-        // Add texture coordinates
-        if (uvs.size() > 0){
-            Face::CornerIterator cit, cend;
-            cit = face->CornerBegin();
-            cend = face->CornerEnd();
-            for (int j = 0; cit != cend; cit++, j++){
-                if (faces[i].t[j] >= uvs.size()){
-                    throw(std::ios_base::failure(std::string("Error: index for texture coordinate ")+num_to_str<int>(faces[i].t[j])+std::string(" in face ")+num_to_str<int>(i)+std::string(" is out of bounds")));
-                } else {
-                    (*cit)->SetUV(uvs[faces[i].t[j]]);
+            // Add texture coordinates
+            if (uvs.size() > 0){
+                Face::CornerIterator cit, cend;
+                cit = face->CornerBegin();
+                cend = face->CornerEnd();
+                for (int j = 0; cit != cend; cit++, j++){
+                    if ((faces[i].t[j] < 0) || (faces[i].t[j] >= (int) uvs.size())){
+                        throw(std::ios_base::failure(std::string("Error: index for texture coordinate ")+num_to_str<int>(faces[i].t[j])+std::string(" in face ")+num_to_str<int>(findex)+std::string(" is out of bounds")));
+                    } else {
+                        (*cit)->SetUV(uvs[faces[i].t[j]]);
+                    }
                 }
             }
         }
@@ -1065,85 +1678,363 @@ void Mesh::ReadObj(const char *filename){
 
 void Mesh::ReadOff(const char *filename){
 
-    // Open file and check for errors
-    std::ifstream f;
-    f.open(filename);
-    if (f.fail()){
-        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
-    }
+    // Map file into memory, decompressing it if needed
+    MappedFile file;
+    file.Open(filename);
+    const char *p = file.Data();
+    const char *end = file.Data() + file.Size();
+
+    // Get the next line, or throw an exception if the file is too short
+    const char *line, *line_end;
+    auto next_line = [&](){
+        if (p >= end){
+            throw(std::ios_base::failure(std::string("Error: file too short")));
+        }
+        line = p;
+        line_end = (const char *) memchr(p, '\n', end - p);
+        if (line_end == NULL){
+            line_end = end;
+        }
+        p = line_end + 1;
+        line = skip_blanks(line, line_end);
+    };
 
     // Read header
     // Read file format identifier
-    std::string line;
-    std::getline(f, line);
-    if (line.substr(0, 3) != "OFF"){
+    if ((end - p < 3) || (memcmp(p, "OFF", 3) != 0)){
         throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". File does not have the OFF identifier")));
     }
+    next_line();
 
     // Read mesh attributes
-    if (f.eof()){
-        throw(std::ios_base::failure(std::string("Error: file too short")));
-    }
-    std::getline(f, line);
-    std::istringstream header(line);
-    IdType num_vertices, num_faces, num_edges;
-    header >> num_vertices >> num_faces >> num_edges;
+    next_line();
+    int num_vertices, num_faces;
+    line = parse_int(line, line_end, num_vertices);
+    line = parse_int(skip_blanks(line, line_end), line_end, num_faces);
 
     // Read vertices
     for (int i = 0; i < num_vertices; i++){
-        if (f.eof()){
-            throw(std::ios_base::failure(std::string("Error: file too short")));
-        }
-        std::getline(f, line);
-        std::istringstream ss(line);
+        next_line();
         PositionType pos;
-        ss >> pos[0] >> pos[1] >> pos[2];
+        for (int j = 0; j < 3; j++){
+            line = parse_float(skip_blanks(line, line_end), line_end, pos[j]);
+        }
         AddVertex(pos);
     }
 
     // Read faces
     for (int i = 0; i < num_faces; i++){
-        if (f.eof()){
-            throw(std::ios_base::failure(std::string("Error: file too short")));
+        next_line();
+        int vcount;
+        IdType v[4];
+        line = parse_int(line, line_end, vcount);
+        if ((vcount != 3) && (vcount != 4)){
+            throw(std::ios_base::failure(std::string("Error: faces need to have exactly 3 or 4 vertices")));
         }
-        std::getline(f, line);
-        std::istringstream ss(line);
-        IdType vcount, v0, v1, v2, v3;
-        ss >> vcount;
-        if (vcount == 3){
-            ss >> v0 >> v1 >> v2;
-            if ((v0 >= VertexCount()) || (v1 >= VertexCount()) || (v2 >= VertexCount())){
+        for (int j = 0; j < vcount; j++){
+            line = parse_int(skip_blanks(line, line_end), line_end, v[j]);
+            if ((v[j] < 0) || (v[j] >= VertexCount())){
                 throw(std::ios_base::failure(std::string("Error: index of vertex in face "+num_to_str<int>(i)+std::string(" out of range"))));
             }
-            AddFace(v0, v1, v2);
-        } else if (vcount == 4){
-            ss >> v0 >> v1 >> v2 >> v3;
-            if ((v0 >= VertexCount()) || (v1 >= VertexCount()) || (v2 >= VertexCount()) || (v3 >= VertexCount())){
-                throw(std::ios_base::failure(std::string("Error: index of vertex in face "+num_to_str<int>(i)+std::string(" out of range"))));
+        }
+        AddFace(v[0], v[1], v[2]);
+        if (vcount == 4){
+            AddFace(v[0], v[2], v[3]);
+        }
+    }
+}
+
+
+void Mesh::ReadBinary(const char *filename, const ReadOptions &options){
+
+    // Map file into memory. The arrays of the file are used in place
+    MappedFile file;
+    file.Open(filename);
+
+    // Check header
+    if (file.Size() < sizeof(BinaryMeshHeader)){
+        throw(std::ios_base::failure(std::string("Error: file too short")));
+    }
+    BinaryMeshHeader header;
+    memcpy(&header, file.Data(), sizeof(BinaryMeshHeader));
+    if (memcmp(header.magic, BinaryMeshMagic, sizeof(header.magic)) != 0){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)+std::string(". File does not have the binary mesh identifier")));
+    }
+    if (header.version != BinaryMeshVersion){
+        throw(std::ios_base::failure(std::string("Error: binary mesh version ")+num_to_str<unsigned int>(header.version)+std::string(" not supported")));
+    }
+    if (header.byte_order != BinaryMeshByteOrder){
+        throw(std::ios_base::failure(std::string("Error: binary mesh was written with a different byte order")));
+    }
+    if (header.checksum != hash_bytes(&header, offsetof(BinaryMeshHeader, checksum))){
+        throw(std::ios_base::failure(std::string("Error: binary mesh header is corrupted")));
+    }
+
+    // Locate arrays. The offsets come from the file, so the bounds are
+    // checked without adding them to the sizes, which could wrap around
+    const char *array[BinaryArrayCount];
+    for (int a = 0; a < BinaryArrayCount; a++){
+        array[a] = NULL;
+        if (header.offset[a] > 0){
+            size_t size = binary_mesh_array_size(header, a);
+            if ((header.offset[a] % BinaryMeshAlignment != 0) || (header.offset[a] > file.Size()) ||
+                (size > file.Size() - header.offset[a])){
+                throw(std::ios_base::failure(std::string("Error: binary mesh array out of bounds")));
             }
+            array[a] = file.Data() + header.offset[a];
+        }
+    }
+    // Ignore the attributes that were not requested
+    if (!options.read_normals){
+        array[BinaryVertexNormal] = NULL;
+        array[BinaryFaceNormal] = NULL;
+        array[BinaryFaceArea] = NULL;
+        array[BinaryCornerNormal] = NULL;
+    }
+    if (!options.read_colors){
+        array[BinaryVertexColor] = NULL;
+    }
+    if (!options.read_uvs){
+        array[BinaryVertexUV] = NULL;
+        array[BinaryCornerUV] = NULL;
+    }
+    if ((array[BinaryPosition] == NULL) || (array[BinaryIndex] == NULL)){
+        throw(std::ios_base::failure(std::string("Error: binary mesh needs positions and faces")));
+    }
+    IdType vertex_count = header.vertex_count;
+    IdType face_count = header.face_count;
+    const float *position = (const float *) array[BinaryPosition];
+    const int *index = (const int *) array[BinaryIndex];
+
+    // Check vertex references in faces
+    std::atomic<bool> valid(true);
+    parallel_for(0, 3*((size_t) face_count), [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            if ((index[i] < 0) || (index[i] >= vertex_count)){
+                valid = false;
+            }
+        }
+    }, 1 << 16);
+    if (!valid){
+        throw(std::ios_base::failure(std::string("Error: index of vertex in binary mesh out of range")));
+    }
 
-            AddFace(v0, v1, v2);
-            AddFace(v0, v2, v3);
-        } else {
-            throw(std::ios_base::failure(std::string("Error: faces need to have exactly 3 or 4 vertices")));
+    // The connectivity table refers to element ids, so it can only be used
+    // when the elements of the file receive ids starting at 0
+    bool empty = (vertex_.size() == 0) && (face_.size() == 0) &&
+                 (last_vertex_id_ < 0) && (last_face_id_ < 0) && (!has_connectivity_);
+
+    // Create vertices
+    std::vector<VertexPtr> vertices(vertex_count);
+    for (IdType i = 0; i < vertex_count; i++){
+        vertices[i] = AddVertex(PositionType(position[3*i], position[3*i+1], position[3*i+2]));
+    }
+    const float *vertex_normal = (const float *) array[BinaryVertexNormal];
+    const float *vertex_color = (const float *) array[BinaryVertexColor];
+    const float *vertex_uv = (const float *) array[BinaryVertexUV];
+    parallel_for(0, vertex_count, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            if (vertex_normal != NULL){
+                vertices[i]->normal_ = NormalType(vertex_normal[3*i], vertex_normal[3*i+1], vertex_normal[3*i+2]);
+            }
+            if (vertex_color != NULL){
+                vertices[i]->color_ = ColorType(vertex_color[3*i], vertex_color[3*i+1], vertex_color[3*i+2]);
+            }
+            if (vertex_uv != NULL){
+                vertices[i]->uv_ = UVType(vertex_uv[2*i], vertex_uv[2*i+1]);
+            }
+        }
+    });
+
+    // Create faces
+    std::vector<FacePtr> faces(face_count);
+    for (IdType i = 0; i < face_count; i++){
+        faces[i] = AddFace(vertices[index[3*i]], vertices[index[3*i+1]], vertices[index[3*i+2]]);
+    }
+    const float *face_normal = (const float *) array[BinaryFaceNormal];
+    const float *face_area = (const float *) array[BinaryFaceArea];
+    const float *corner_normal = (const float *) array[BinaryCornerNormal];
+    const float *corner_uv = (const float *) array[BinaryCornerUV];
+    parallel_for(0, face_count, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++){
+            if (face_normal != NULL){
+                faces[i]->normal_ = NormalType(face_normal[3*i], face_normal[3*i+1], face_normal[3*i+2]);
+            }
+            if (face_area != NULL){
+                faces[i]->area_ = face_area[i];
+            }
+            for (int k = 0; k < 3; k++){
+                if (corner_normal != NULL){
+                    const float *n = corner_normal + 9*i + 3*k;
+                    faces[i]->corner_[k].normal_ = NormalType(n[0], n[1], n[2]);
+                }
+                if (corner_uv != NULL){
+                    const float *t = corner_uv + 6*i + 2*k;
+                    faces[i]->corner_[k].uv_ = UVType(t[0], t[1]);
+                }
+            }
         }
+    });
+
+    // Set flags
+    if (vertex_color != NULL){
+        color_scheme_ = (ColorScheme) header.color_scheme;
+    }
+    if (vertex_normal != NULL){
+        has_vertex_normals_ = true;
+    }
+    if (face_normal != NULL){
+        has_face_normals_ = true;
     }
 
-    // Close file
-    f.close();
+    // Use the stored connectivity, if possible
+    const int *table_offset = (const int *) array[BinaryVertexFaceOffset];
+    const int *table_face = (const int *) array[BinaryVertexFace];
+    if (empty && (table_offset != NULL) && (table_face != NULL)){
+        // Check the table
+        valid = (table_offset[0] == 0) && (table_offset[vertex_count] == (int) header.vertex_face_count);
+        parallel_for(0, vertex_count, [&](size_t begin, size_t end){
+            for (size_t v = begin; v < end; v++){
+                if (table_offset[v] > table_offset[v+1]){
+                    valid = false;
+                }
+            }
+        }, 1 << 16);
+        if (valid){
+            parallel_for(0, header.vertex_face_count, [&](size_t begin, size_t end){
+                for (size_t i = begin; i < end; i++){
+                    if ((table_face[i] < 0) || (table_face[i] >= face_count)){
+                        valid = false;
+                    }
+                }
+            }, 1 << 16);
+        }
+        if (!valid){
+            throw(std::ios_base::failure(std::string("Error: vertex-to-face table of binary mesh is corrupted")));
+        }
+
+        // Install the table and the faces of each vertex
+        vertex_face_table_.offset.assign(table_offset, table_offset + vertex_count + 1);
+        vertex_face_table_.face.assign(table_face, table_face + header.vertex_face_count);
+        has_vertex_face_table_ = true;
+        AssignVertexFacesFromTable();
+        has_connectivity_ = true;
+    }
+}
+
+
+void Mesh::ReadPly(const char *filename, const ReadOptions &options){
+
+    // Map file into memory and decode the elements into arrays
+    MappedFile file;
+    file.Open(filename);
+    PlyData data;
+    parse_ply(file.Data(), file.Data() + file.Size(), data, read_attributes(options));
+    file.Close();
+
+    // Create vertices
+    std::vector<VertexPtr> vertices(data.position.size());
+    for (size_t i = 0; i < data.position.size(); i++){
+        VertexPtr vertex = AddVertex(data.position[i]);
+        if (data.normal.size() > 0){
+            vertex->SetNormal(data.normal[i]);
+        }
+        if (data.color.size() > 0){
+            vertex->SetColor(data.color[i]);
+        }
+        if (data.uv.size() > 0){
+            vertex->SetUV(data.uv[i]);
+        }
+        vertices[i] = vertex;
+    }
+    if (data.color.size() > 0){
+        color_scheme_ = VertexColor;
+    }
+    if (data.normal.size() > 0){
+        has_vertex_normals_ = true;
+    }
+
+    // Create faces
+    for (size_t i = 0; i < data.index.size()/3; i++){
+        // Check if vertex references in face are correct
+        const int *index = &data.index[3*i];
+        for (int j = 0; j < 3; j++){
+            if ((index[j] < 0) || (index[j] >= (int) vertices.size())){
+                throw(std::ios_base::failure(std::string("Error: index of vertex in face ")+num_to_str<size_t>(i)+std::string(" out of range")));
+            }
+        }
+        FacePtr face = AddFace(vertices[index[0]], vertices[index[1]], vertices[index[2]]);
+        // Add texture coordinates
+        if (data.corner_uv.size() > 0){
+            for (int j = 0; j < 3; j++){
+                face->corner_[j].uv_ = data.corner_uv[3*i+j];
+            }
+        }
+    }
+
+    // Copy face uvs to vertices, if the vertices do not have their own
+    if ((data.corner_uv.size() > 0) && (data.uv.size() == 0)){
+        CopyCornerUVsToVertices();
+    }
+}
+
+
+void Mesh::ReadStl(const char *filename, const ReadOptions &options){
+
+    // Map file into memory and decode the triangles into an array
+    MappedFile file;
+    file.Open(filename);
+    StlData data;
+    parse_stl(file.Data(), file.Data() + file.Size(), data);
+    file.Close();
+
+    // Each triangle of the file has its own vertices, so merge the
+    // coincident ones to obtain a connected mesh
+    std::vector<int> index;
+    std::vector<PositionType> position;
+    weld_positions(data.position, options.weld_epsilon, index, position);
+
+    // Create vertices
+    std::vector<VertexPtr> vertices(position.size());
+    for (size_t i = 0; i < position.size(); i++){
+        vertices[i] = AddVertex(position[i]);
+    }
+
+    // Create faces, skipping the ones that collapsed during welding
+    for (size_t i = 0; i < index.size()/3; i++){
+        int v0 = index[3*i], v1 = index[3*i+1], v2 = index[3*i+2];
+        if ((v0 == v1) || (v1 == v2) || (v2 == v0)){
+            continue;
+        }
+        AddFace(vertices[v0], vertices[v1], vertices[v2]);
+    }
+}
+
+
+// Color of a vertex to write, taken from the color array of the options
+// when there is one
+static inline ColorType write_color(const Vertex *vertex, const Mesh::WriteOptions &options){
+
+    return (options.vertex_colors != NULL) ? options.vertex_colors[vertex->GetId()] : vertex->GetColor();
 }
 
 
 void Mesh::Write(const char *filename, const WriteOptions &options){
 
     std::string fn = std::string(filename); 
-    std::string ext = get_extension(fn);
+    std::string ext = mesh_extension(fn);
     if ((ext == std::string("obj")) ||
         (ext == std::string("OBJ"))){
         WriteObj(filename, options);
     } else if ((ext == std::string("off")) ||
                (ext == std::string("OFF"))){
         WriteOff(filename, options);
+    } else if ((ext == std::string("gpm")) ||
+               (ext == std::string("GPM"))){
+        WriteBinary(filename, options);
+    } else if ((ext == std::string("ply")) ||
+               (ext == std::string("PLY"))){
+        WritePly(filename, options);
     } else {
         throw(std::ios_base::failure(std::string("Error: extension \"")+ext+std::string("\" not supported")));
     }
@@ -1153,11 +2044,8 @@ void Mesh::Write(const char *filename, const WriteOptions &options){
 void Mesh::WriteObj(const char *filename, const WriteOptions &options){
 
     // Open file and check for errors
-    std::ofstream f;
-    f.open(filename);
-    if (f.fail()){
-        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
-    }
+    OutputBuffer f(options.precision);
+    f.Open(filename);
 
     // Check flag consistency
     if (options.write_vertex_normals && options.write_face_normals){
@@ -1186,188 +2074,489 @@ void Mesh::WriteObj(const char *filename, const WriteOptions &options){
         mf << "map_Kd " << options.texture_name << std::endl;
         mf.close(); 
         // Request obj file to use material
-        f << "mtllib " << material_filename << std::endl;
-        f << "usemtl textured" << std::endl;
+        f.Write("mtllib ");
+        f.Write(material_filename.c_str());
+        f.Write("\nusemtl textured\n");
     }
 
+    // Gather the elements into arrays, so that ranges of elements can be
+    // formatted in parallel
+    std::vector<VertexPtr> vertices;
+    std::vector<FacePtr> faces;
+    GetElementArrays(vertices, faces);
+
     // Write vertices
-    VertexIterator vit, vend;
-    vit = VertexBegin();
-    vend = VertexEnd();
-    if (options.write_vertex_colors){
-        // Write vertex positions with colors
-        for (; vit != vend; vit++){
-            VertexPtr vertex = (*vit);
-            PositionType pos = vertex->GetPosition();
-            ColorType color = vertex->GetColor();
-            f << "v " << pos[0] << " " << pos[1] << " " << pos[2] << " " << color[0] << " " << color[1] << " " << color[2] << std::endl;
-        }
-    } else {
-        // Write only vertex positions
-        for (; vit != vend; vit++){
-            VertexPtr vertex = (*vit);
-            PositionType pos = vertex->GetPosition();
-            f << "v " << pos[0] << " " << pos[1] << " " << pos[2] << std::endl;
+    f.WriteParallel(vertices.size(), [&](OutputBuffer &b, size_t i){
+        VertexPtr vertex = vertices[i];
+        PositionType pos = vertex->GetPosition();
+        b.Write("v ");
+        b.WriteFloat(pos[0]);
+        b.Write(' ');
+        b.WriteFloat(pos[1]);
+        b.Write(' ');
+        b.WriteFloat(pos[2]);
+        if (options.write_vertex_colors){
+            // Write vertex colors after the position
+            ColorType color = write_color(vertex, options);
+            b.Write(' ');
+            b.WriteFloat(color[0]);
+            b.Write(' ');
+            b.WriteFloat(color[1]);
+            b.Write(' ');
+            b.WriteFloat(color[2]);
         }
-    }
+        b.Write('\n');
+    });
 
     // Write list of texture coordinates
+    auto write_uv = [](OutputBuffer &b, const UVType &uv){
+        b.Write("vt ");
+        b.WriteFloat(uv[0]);
+        b.Write(' ');
+        b.WriteFloat(uv[1]);
+        b.Write('\n');
+    };
     if (options.write_vertex_uvs){
-        VertexIterator vit, vend;
-        vit = VertexBegin();
-        vend = VertexEnd();
-        for (; vit != vend; vit++){
-            UVType uv = (*vit)->GetUV();
-            f << "vt " << uv[0] << " " << uv[1] << std::endl;
-        }
+        f.WriteParallel(vertices.size(), [&](OutputBuffer &b, size_t i){
+            write_uv(b, vertices[i]->GetUV());
+        });
     } else if (options.write_face_uvs){
-        FaceIterator fit, fend;
-        fit = FaceBegin();
-        fend = FaceEnd();
-        for (; fit != fend; fit++){
+        f.WriteParallel(faces.size(), [&](OutputBuffer &b, size_t i){
             Face::CornerIterator cit, cend;
-            cit = (*fit)->CornerBegin();
-            cend = (*fit)->CornerEnd();
+            cit = faces[i]->CornerBegin();
+            cend = faces[i]->CornerEnd();
             for (; cit != cend; cit++){
-                UVType uv = (*cit)->GetUV();
-                f << "vt " << uv[0] << " " << uv[1] << std::endl;
+                write_uv(b, (*cit)->GetUV());
             }
-        }
+        });
     }
 
     // Write list of normals
+    auto write_normal = [](OutputBuffer &b, const NormalType &normal){
+        b.Write("vn ");
+        b.WriteFloat(normal[0]);
+        b.Write(' ');
+        b.WriteFloat(normal[1]);
+        b.Write(' ');
+        b.WriteFloat(normal[2]);
+        b.Write('\n');
+    };
     if (options.write_vertex_normals){
-        VertexIterator vit, vend;
-        vit = VertexBegin();
-        vend = VertexEnd();
-        for (; vit != vend; vit++){
-            NormalType normal = (*vit)->GetNormal();
-            f << "vn " << normal[0] << " " << normal[1] << " " << normal[2] << std::endl;
-        }
+        f.WriteParallel(vertices.size(), [&](OutputBuffer &b, size_t i){
+            write_normal(b, vertices[i]->GetNormal());
+        });
     } else if (options.write_face_normals){
-        FaceIterator fit, fend;
-        fit = FaceBegin();
-        fend = FaceEnd();
-        for (; fit != fend; fit++){
+        f.WriteParallel(faces.size(), [&](OutputBuffer &b, size_t i){
             Face::CornerIterator cit, cend;
-            cit = (*fit)->CornerBegin();
-            cend = (*fit)->CornerEnd();
+            cit = faces[i]->CornerBegin();
+            cend = faces[i]->CornerEnd();
             for (; cit != cend; cit++){
-                NormalType normal = (*cit)->GetNormal();
-                f << "vn " << normal[0] << " " << normal[1] << " " << normal[2] << std::endl;
+                write_normal(b, (*cit)->GetNormal());
             }
-        }
+        });
     }
 
     // Write faces
-    FaceIterator fit, fend;
-    fit = FaceBegin();
-    fend = FaceEnd();
-    if ((!options.write_vertex_normals) &&
-        (!options.write_face_normals) && 
-        (!options.write_vertex_uvs) && 
-        (!options.write_face_uvs)){
-        // Write only vertex indices
-        for (; fit != fend; fit++){
-            // Get the current face
-            FacePtr face = (*fit);
-            // Write face
-            f << "f " << face->GetVertex(0)->GetId()+1 << " " << face->GetVertex(1)->GetId()+1 << " " << face->GetVertex(2)->GetId()+1 << std::endl;
-        }
-    } else {
-        // Write more attributes
-        // Check which attribute separators we need to write
-        std::string sep1, sep2;
-        sep1 = "/";
-        sep2 = "/";
-        if ((options.write_vertex_uvs || options.write_face_uvs) && 
-            (!(options.write_vertex_normals || options.write_face_normals))){
-            sep2 = "";
-        }
-        // Write faces
-        for (int findex = 0; fit != fend; fit++, findex++){
-            // Get the current face
-            FacePtr face = (*fit);
-            // Get face attributes
-            // Positions
-            std::string v0, v1, v2, t0, t1, t2, n0, n1, n2;
-            v0 = num_to_str<IdType>(face->GetVertex(0)->GetId() + 1);
-            v1 = num_to_str<IdType>(face->GetVertex(1)->GetId() + 1);
-            v2 = num_to_str<IdType>(face->GetVertex(2)->GetId() + 1);
-            // Texture coordinates
-            if (options.write_vertex_uvs){
-                t0 = v0;
-                t1 = v1;
-                t2 = v2;
-            } else if (options.write_face_uvs){
-                t0 = num_to_str<IdType>(findex*3 + 1);
-                t1 = num_to_str<IdType>(findex*3 + 1 + 1);
-                t2 = num_to_str<IdType>(findex*3 + 2 + 1);
-            } else {
-                t0 = "";
-                t1 = "";
-                t2 = "";
-            }
-            // Normals
-            if (options.write_vertex_normals){
-                n0 = v0;
-                n1 = v1;
-                n2 = v2;
-            } else if (options.write_face_normals){
-                n0 = num_to_str<IdType>(findex*3 + 1);
-                n1 = num_to_str<IdType>(findex*3 + 1 + 1);
-                n2 = num_to_str<IdType>(findex*3 + 2 + 1);
-            } else {
-                n0 = "";
-                n1 = "";
-                n2 = "";
+    // Check which attributes we need to write
+    bool write_uvs = options.write_vertex_uvs || options.write_face_uvs;
+    bool write_normals = options.write_vertex_normals || options.write_face_normals;
+    f.WriteParallel(faces.size(), [&](OutputBuffer &b, size_t findex){
+        // Get the current face
+        FacePtr face = faces[findex];
+        b.Write('f');
+        for (int j = 0; j < 3; j++){
+            // Position index, followed by the indices of the texture
+            // coordinate and normal, which are either the index of the
+            // vertex or of the corner
+            IdType v = face->GetVertex(j)->GetId() + 1;
+            IdType c = findex*3 + j + 1;
+            b.Write(' ');
+            b.WriteInt(v);
+            if (write_uvs || write_normals){
+                b.Write('/');
+                if (write_uvs){
+                    b.WriteInt(options.write_vertex_uvs ? v : c);
+                }
+                if (write_normals){
+                    b.Write('/');
+                    b.WriteInt(options.write_vertex_normals ? v : c);
+                }
             }
-            // Write the face with all the attributes
-            f << "f " << v0 << sep1 << t0 << sep2 << n0 << " " << v1 << sep1 << t1 << sep2 << n1 << " " << v2 << sep1 << t2 << sep2 << n2 << std::endl;
         }
-    }
+        b.Write('\n');
+    });
 
     // Close file
-    f.close();
+    f.Close();
 }
 
 
 void Mesh::WriteOff(const char *filename, const WriteOptions &options){
 
     // Open file and check for errors
-    std::ofstream f;
-    f.open(filename);
-    if (f.fail()){
-        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
-    }
+    OutputBuffer f(options.precision);
+    f.Open(filename);
    
     // Write header
-    f << "OFF" << std::endl;
-    f << VertexCount() << " " << FaceCount() << " 0" << std::endl;
+    f.Write("OFF\n");
+    f.WriteInt(VertexCount());
+    f.Write(' ');
+    f.WriteInt(FaceCount());
+    f.Write(" 0\n");
+
+    // Gather the elements into arrays, so that ranges of elements can be
+    // formatted in parallel
+    std::vector<VertexPtr> vertices;
+    std::vector<FacePtr> faces;
+    GetElementArrays(vertices, faces);
 
     // Write vertices
-    VertexIterator vit, vend;
-    vit = VertexBegin();
-    vend = VertexEnd();
-    for (; vit != vend; vit++){
-        VertexPtr vertex = (*vit);
-        PositionType pos = vertex->GetPosition();
-        f << pos[0] << " " << pos[1] << " " << pos[2] << std::endl;
-    }
+    f.WriteParallel(vertices.size(), [&](OutputBuffer &b, size_t i){
+        PositionType pos = vertices[i]->GetPosition();
+        b.WriteFloat(pos[0]);
+        b.Write(' ');
+        b.WriteFloat(pos[1]);
+        b.Write(' ');
+        b.WriteFloat(pos[2]);
+        b.Write('\n');
+    });
 
     // Write faces
-    FaceIterator fit, fend;
-    fit = FaceBegin();
-    fend = FaceEnd();
-    for (; fit != fend; fit++){
-        // Get the current face
-        FacePtr face = (*fit);
-        // Write face
-        f << "3 " << face->GetVertex(0)->GetId() << " " << face->GetVertex(1)->GetId() << " " << face->GetVertex(2)->GetId() << std::endl;
-    }
+    f.WriteParallel(faces.size(), [&](OutputBuffer &b, size_t i){
+        FacePtr face = faces[i];
+        b.Write("3 ");
+        b.WriteInt(face->GetVertex(0)->GetId());
+        b.Write(' ');
+        b.WriteInt(face->GetVertex(1)->GetId());
+        b.Write(' ');
+        b.WriteInt(face->GetVertex(2)->GetId());
+        b.Write('\n');
+    });
 
     // Close file
-    f.close();
+    f.Close();
+}
+
+
+void Mesh::WriteBinary(const char *filename, const WriteOptions &options){
+
+    // The arrays of the format refer to vertices and faces by index, so
+    // the ids need to be sequential
+    if ((last_vertex_id_ + 1 != VertexCount()) || (last_face_id_ + 1 != FaceCount())){
+        throw(std::ios_base::failure(std::string("Error: ids need to be sequential to write a binary mesh, call ReindexIds first")));
+    }
+
+    // Open file, which throws an exception on errors
+    OutputFile f;
+    f.Open(filename);
+
+    // Gather the elements into arrays
+    std::vector<VertexPtr> vertices;
+    std::vector<FacePtr> faces;
+    GetElementArrays(vertices, faces);
+
+    // Set up header
+    BinaryMeshHeader header;
+    memset(&header, 0, sizeof(BinaryMeshHeader));
+    memcpy(header.magic, BinaryMeshMagic, sizeof(header.magic));
+    header.version = BinaryMeshVersion;
+    header.byte_order = BinaryMeshByteOrder;
+    header.vertex_count = vertices.size();
+    header.face_count = faces.size();
+    header.color_scheme = color_scheme_;
+    bool present[BinaryArrayCount];
+    present[BinaryPosition] = true;
+    present[BinaryIndex] = true;
+    present[BinaryVertexNormal] = options.write_vertex_normals;
+    present[BinaryVertexColor] = options.write_vertex_colors;
+    present[BinaryVertexUV] = options.write_vertex_uvs;
+    present[BinaryFaceNormal] = options.write_face_normals;
+    present[BinaryFaceArea] = options.write_face_normals;
+    present[BinaryCornerNormal] = options.write_face_normals;
+    present[BinaryCornerUV] = options.write_face_uvs;
+    present[BinaryVertexFaceOffset] = options.write_connectivity && has_connectivity_;
+    present[BinaryVertexFace] = options.write_connectivity && has_connectivity_;
+    if (present[BinaryVertexFace]){
+        header.vertex_face_count = GetVertexFaceTable().face.size();
+    }
+    size_t pos = sizeof(BinaryMeshHeader);
+    for (int a = 0; a < BinaryArrayCount; a++){
+        if (present[a]){
+            pos = ((pos + BinaryMeshAlignment - 1)/BinaryMeshAlignment)*BinaryMeshAlignment;
+            header.offset[a] = pos;
+            pos += binary_mesh_array_size(header, a);
+        }
+    }
+    header.checksum = hash_bytes(&header, offsetof(BinaryMeshHeader, checksum));
+
+    // Write header
+    f.Write(&header, sizeof(BinaryMeshHeader));
+    pos = sizeof(BinaryMeshHeader);
+
+    // Write each array, which is first filled in parallel in memory
+    std::vector<float> data;
+    const char zero[BinaryMeshAlignment] = {0};
+    for (int a = 0; a < BinaryArrayCount; a++){
+        if (!present[a]){
+            continue;
+        }
+        size_t size = binary_mesh_array_size(header, a);
+        data.resize((size + sizeof(float) - 1)/sizeof(float));
+        float *fl = data.data();
+        int *in = (int *) data.data();
+        switch (a){
+            case BinaryPosition:
+            case BinaryVertexNormal:
+            case BinaryVertexColor:
+            case BinaryVertexUV:
+                parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+                    for (size_t i = begin; i < end; i++){
+                        VertexPtr v = vertices[i];
+                        if (a == BinaryPosition){
+                            fl[3*i] = v->position_[0]; fl[3*i+1] = v->position_[1]; fl[3*i+2] = v->position_[2];
+                        } else if (a == BinaryVertexNormal){
+                            fl[3*i] = v->normal_[0]; fl[3*i+1] = v->normal_[1]; fl[3*i+2] = v->normal_[2];
+                        } else if (a == BinaryVertexColor){
+                            ColorType color = write_color(v, options);
+                            fl[3*i] = color[0]; fl[3*i+1] = color[1]; fl[3*i+2] = color[2];
+                        } else {
+                            fl[2*i] = v->uv_[0]; fl[2*i+1] = v->uv_[1];
+                        }
+                    }
+                });
+                break;
+            case BinaryIndex:
+            case BinaryFaceNormal:
+            case BinaryFaceArea:
+            case BinaryCornerNormal:
+            case BinaryCornerUV:
+                parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+                    for (size_t i = begin; i < end; i++){
+                        FacePtr face = faces[i];
+                        if (a == BinaryIndex){
+                            for (int k = 0; k < 3; k++){
+                                in[3*i+k] = face->corner_[k].vertex_->id_;
+                            }
+                        } else if (a == BinaryFaceNormal){
+                            fl[3*i] = face->normal_[0]; fl[3*i+1] = face->normal_[1]; fl[3*i+2] = face->normal_[2];
+                        } else if (a == BinaryFaceArea){
+                            fl[i] = face->area_;
+                        } else if (a == BinaryCornerNormal){
+                            for (int k = 0; k < 3; k++){
+                                for (int j = 0; j < 3; j++){
+                                    fl[9*i+3*k+j] = face->corner_[k].normal_[j];
+                                }
+                            }
+                        } else {
+                            for (int k = 0; k < 3; k++){
+                                fl[6*i+2*k] = face->corner_[k].uv_[0];
+                                fl[6*i+2*k+1] = face->corner_[k].uv_[1];
+                            }
+                        }
+                    }
+                });
+                break;
+            case BinaryVertexFaceOffset:
+                memcpy(in, GetVertexFaceTable().offset.data(), size);
+                break;
+            case BinaryVertexFace:
+                memcpy(in, GetVertexFaceTable().face.data(), size);
+                break;
+        }
+        // Pad up to the offset of the array and write the array
+        f.Write(zero, header.offset[a] - pos);
+        f.Write(data.data(), size);
+        pos = header.offset[a] + size;
+    }
+
+    // Close file, which throws an exception if any data was not written
+    f.Close();
+}
+
+
+void Mesh::WritePly(const char *filename, const WriteOptions &options){
+
+    // Faces refer to vertices by index, so the ids need to be sequential
+    if ((last_vertex_id_ + 1 != VertexCount()) || (last_face_id_ + 1 != FaceCount())){
+        throw(std::ios_base::failure(std::string("Error: ids need to be sequential to write a ply mesh, call ReindexIds first")));
+    }
+
+    // Gather the elements into arrays
+    std::vector<VertexPtr> vertices;
+    std::vector<FacePtr> faces;
+    GetElementArrays(vertices, faces);
+
+    // Write header. Binary files are written in the byte order of the
+    // machine
+    std::ostringstream header;
+    header << "ply" << std::endl;
+    if (options.ascii){
+        header << "format ascii 1.0" << std::endl;
+    } else if (host_is_little_endian()){
+        header << "format binary_little_endian 1.0" << std::endl;
+    } else {
+        header << "format binary_big_endian 1.0" << std::endl;
+    }
+    header << "element vertex " << vertices.size() << std::endl;
+    header << "property float x" << std::endl;
+    header << "property float y" << std::endl;
+    header << "property float z" << std::endl;
+    if (options.write_vertex_normals){
+        header << "property float nx" << std::endl;
+        header << "property float ny" << std::endl;
+        header << "property float nz" << std::endl;
+    }
+    if (options.write_vertex_colors){
+        header << "property uchar red" << std::endl;
+        header << "property uchar green" << std::endl;
+        header << "property uchar blue" << std::endl;
+    }
+    if (options.write_vertex_uvs){
+        header << "property float s" << std::endl;
+        header << "property float t" << std::endl;
+    }
+    header << "element face " << faces.size() << std::endl;
+    header << "property list uchar int vertex_indices" << std::endl;
+    if (options.write_face_uvs){
+        header << "property list uchar float texcoord" << std::endl;
+    }
+    header << "end_header" << std::endl;
+    std::string header_text = header.str();
+
+    // Colors are stored as bytes
+    auto color_byte = [](float c) -> unsigned char {
+        return (unsigned char) (std::min(std::max(c, 0.0f), 1.0f)*255.0f + 0.5f);
+    };
+
+    if (options.ascii){
+        // Open file and write header
+        OutputBuffer f(options.precision);
+        f.Open(filename);
+        f.Write(header_text.data(), header_text.size());
+
+        // Write vertices
+        f.WriteParallel(vertices.size(), [&](OutputBuffer &b, size_t i){
+            VertexPtr v = vertices[i];
+            b.WriteFloat(v->position_[0]);
+            b.Write(' ');
+            b.WriteFloat(v->position_[1]);
+            b.Write(' ');
+            b.WriteFloat(v->position_[2]);
+            if (options.write_vertex_normals){
+                for (int k = 0; k < 3; k++){
+                    b.Write(' ');
+                    b.WriteFloat(v->normal_[k]);
+                }
+            }
+            if (options.write_vertex_colors){
+                ColorType color = write_color(v, options);
+                for (int k = 0; k < 3; k++){
+                    b.Write(' ');
+                    b.WriteInt(color_byte(color[k]));
+                }
+            }
+            if (options.write_vertex_uvs){
+                b.Write(' ');
+                b.WriteFloat(v->uv_[0]);
+                b.Write(' ');
+                b.WriteFloat(v->uv_[1]);
+            }
+            b.Write('\n');
+        });
+
+        // Write faces
+        f.WriteParallel(faces.size(), [&](OutputBuffer &b, size_t i){
+            FacePtr face = faces[i];
+            b.Write('3');
+            for (int k = 0; k < 3; k++){
+                b.Write(' ');
+                b.WriteInt(face->corner_[k].vertex_->id_);
+            }
+            if (options.write_face_uvs){
+                b.Write(" 6");
+                for (int k = 0; k < 3; k++){
+                    b.Write(' ');
+                    b.WriteFloat(face->corner_[k].uv_[0]);
+                    b.Write(' ');
+                    b.WriteFloat(face->corner_[k].uv_[1]);
+                }
+            }
+            b.Write('\n');
+        });
+
+        // Close file
+        f.Close();
+    } else {
+        // Open file, which throws an exception on errors
+        OutputFile f;
+        f.Open(filename);
+        f.Write(header_text.data(), header_text.size());
+
+        // Fill the fixed-size records of each element in parallel and
+        // write them in one block
+        size_t vertex_size = 3*sizeof(float);
+        if (options.write_vertex_normals){
+            vertex_size += 3*sizeof(float);
+        }
+        if (options.write_vertex_colors){
+            vertex_size += 3;
+        }
+        if (options.write_vertex_uvs){
+            vertex_size += 2*sizeof(float);
+        }
+        std::vector<char> data(vertex_size*vertices.size());
+        parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; i++){
+                VertexPtr v = vertices[i];
+                char *p = &data[vertex_size*i];
+                memcpy(p, &v->position_[0], 3*sizeof(float));
+                p += 3*sizeof(float);
+                if (options.write_vertex_normals){
+                    memcpy(p, &v->normal_[0], 3*sizeof(float));
+                    p += 3*sizeof(float);
+                }
+                if (options.write_vertex_colors){
+                    ColorType color = write_color(v, options);
+                    for (int k = 0; k < 3; k++){
+                        *p++ = color_byte(color[k]);
+                    }
+                }
+                if (options.write_vertex_uvs){
+                    memcpy(p, &v->uv_[0], 2*sizeof(float));
+                }
+            }
+        });
+        f.Write(data.data(), data.size());
+
+        size_t face_size = 1 + 3*sizeof(int);
+        if (options.write_face_uvs){
+            face_size += 1 + 6*sizeof(float);
+        }
+        data.resize(face_size*faces.size());
+        parallel_for(0, faces.size(), [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; i++){
+                FacePtr face = faces[i];
+                char *p = &data[face_size*i];
+                *p++ = 3;
+                for (int k = 0; k < 3; k++){
+                    int id = face->corner_[k].vertex_->id_;
+                    memcpy(p, &id, sizeof(int));
+                    p += sizeof(int);
+                }
+                if (options.write_face_uvs){
+                    *p++ = 6;
+                    for (int k = 0; k < 3; k++){
+                        memcpy(p, &face->corner_[k].uv_[0], 2*sizeof(float));
+                        p += 2*sizeof(float);
+                    }
+                }
+            }
+        });
+        f.Write(data.data(), data.size());
+
+        // Close file, which throws an exception if any data was not written
+        f.Close();
+    }
 }
 
 
@@ -1425,8 +2614,11 @@ VertexPtr Mesh::AddVertex(PositionType position){
 
     last_vertex_id_++;
     VertexPtr vertex = new Vertex(last_vertex_id_);
+    vertex->geometry_cache_ = geometry_cache_;
     vertex->SetPosition(position);
-    vertex_.insert(VertexContainer::value_type(last_vertex_id_, vertex));
+    // Ids are increasing, so the vertex always goes at the end
+    vertex_.insert(vertex_.end(), VertexContainer::value_type(last_vertex_id_, vertex));
+    TopologyChanged();
     return vertex;
 }
 
@@ -1439,7 +2631,8 @@ FacePtr Mesh::AddFace(VertexPtr v1, VertexPtr v2, VertexPtr v3){
     face->AddVertex(v1);
     face->AddVertex(v2);
     face->AddVertex(v3);
-    face_.insert(FaceContainer::value_type(last_face_id_, face));
+    face_.insert(face_.end(), FaceContainer::value_type(last_face_id_, face));
+    TopologyChanged();
 
     // Add pointers to vertices back to face, if required
     if (has_connectivity_){
@@ -1464,6 +2657,9 @@ VertexPtr Mesh::RemoveVertex(IdType id){
     VertexContainer::iterator vit = vertex_.find(id); 
     VertexPtr vertex = vit->second;
     vertex_.erase(vit);
+    // The vertex is no longer part of the mesh
+    vertex->geometry_cache_ = NULL;
+    TopologyChanged();
     return vertex;
 }
 
@@ -1471,6 +2667,8 @@ VertexPtr Mesh::RemoveVertex(IdType id){
 void Mesh::RemoveVertex(VertexPtr vertex){
 
     vertex_.erase(vertex_.find(vertex->id_));
+    vertex->geometry_cache_ = NULL;
+    TopologyChanged();
 }
 
 
@@ -1492,6 +2690,7 @@ FacePtr Mesh::RemoveFace(IdType id){
 
     // Remove the face
     face_.erase(fit);
+    TopologyChanged();
 
     // Return face
     return face;
@@ -1512,44 +2711,182 @@ void Mesh::RemoveFace(FacePtr face){
 
     // Remove the face
     face_.erase(face_.find(face->id_));
+    TopologyChanged();
 }
 
 
-void Mesh::ReindexIds(void){
+// Check if the element with the given id is marked in the mask
+static bool IsMarked(const std::vector<bool> &mask, IdType id){
 
-    // Reset ids
-    last_vertex_id_ = -1;
-    last_face_id_ = -1;
+    return (id >= 0) && (id < (IdType) mask.size()) && mask[id];
+}
 
-    // Assign ids sequentially to vertices
-    VertexContainer::iterator vit, vend;
-    vit = vertex_.begin();
-    vend = vertex_.end();
-    for (; vit != vend; vit++){
-        VertexPtr vertex = (*vit).second;
-        // Remove vertex from container
-        vertex_.erase(vertex->id_);
-        // Assign new sequential id
-        last_vertex_id_++;
-        vertex->id_ = last_vertex_id_;
-        // Add vertex back to the container
-        vertex_.insert(VertexContainer::value_type(vertex->id_, vertex));
+
+// Create a mask with the given ids marked
+static std::vector<bool> MaskFromIds(const std::vector<IdType> &ids, IdType size){
+
+    std::vector<bool> mask(size, false);
+    for (unsigned int i = 0; i < ids.size(); i++){
+        if ((ids[i] >= 0) && (ids[i] < size)){
+            mask[ids[i]] = true;
+        }
     }
+    return mask;
+}
 
-    // Assign ids sequentially to faces
+
+void Mesh::RemoveVertices(const std::vector<bool> &mask){
+
+    // Mark the faces that reference removed vertices
+    std::vector<bool> face_mask(last_face_id_ + 1, false);
     FaceContainer::iterator fit, fend;
     fit = face_.begin();
     fend = face_.end();
     for (; fit != fend; fit++){
         FacePtr face = (*fit).second;
-        // Remove face from container
-        face_.erase(face->id_);
-        // Assign new sequential id
-        last_face_id_++;
-        face->id_ = last_face_id_;
-        // Add vertex back to the container
-        face_.insert(FaceContainer::value_type(face->id_, face));
+        CornerContainer::iterator cit, cend;
+        cit = face->corner_.begin();
+        cend = face->corner_.end();
+        for (; cit != cend; cit++){
+            if (IsMarked(mask, (*cit).vertex_->id_)){
+                face_mask[face->id_] = true;
+                break;
+            }
+        }
+    }
+
+    // Remove the faces first, so that no face references a removed vertex
+    RemoveFaces(face_mask);
+
+    // Remove and delete the vertices
+    VertexContainer::iterator vit = vertex_.begin();
+    while (vit != vertex_.end()){
+        if (IsMarked(mask, (*vit).first)){
+            delete (*vit).second;
+            vit = vertex_.erase(vit);
+        } else {
+            vit++;
+        }
     }
+
+    // Release the tables, which are rebuilt on demand
+    TopologyChanged();
+    vertex_face_table_ = VertexFaceTable();
+    edge_table_ = EdgeTable();
+}
+
+
+void Mesh::RemoveVertices(const std::vector<IdType> &ids){
+
+    RemoveVertices(MaskFromIds(ids, last_vertex_id_ + 1));
+}
+
+
+void Mesh::RemoveFaces(const std::vector<bool> &mask){
+
+    // Take the removed faces out of the container. Erasing through an
+    // iterator takes amortized constant time
+    std::vector<FacePtr> removed;
+    FaceContainer::iterator fit = face_.begin();
+    while (fit != face_.end()){
+        if (IsMarked(mask, (*fit).first)){
+            removed.push_back((*fit).second);
+            fit = face_.erase(fit);
+        } else {
+            fit++;
+        }
+    }
+    if (removed.size() == 0){
+        return;
+    }
+
+    // Remove the faces from the lists of faces of the vertices
+    if (has_connectivity_){
+        std::vector<VertexPtr> vertices;
+        vertices.reserve(vertex_.size());
+        VertexContainer::iterator vit, vend;
+        vit = vertex_.begin();
+        vend = vertex_.end();
+        for (; vit != vend; vit++){
+            vertices.push_back((*vit).second);
+        }
+        parallel_for(0, vertices.size(), [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; i++){
+                FaceInVertexContainer &faces = vertices[i]->face_;
+                FaceInVertexContainer::iterator last;
+                last = std::remove_if(faces.begin(), faces.end(), [&mask](FacePtr face){ return IsMarked(mask, face->id_); });
+                if (last != faces.end()){
+                    faces.erase(last, faces.end());
+                    faces.shrink_to_fit();
+                }
+            }
+        });
+    }
+
+    // Delete the faces
+    for (unsigned int i = 0; i < removed.size(); i++){
+        delete removed[i];
+    }
+
+    // Release the tables, which are rebuilt on demand
+    TopologyChanged();
+    vertex_face_table_ = VertexFaceTable();
+    edge_table_ = EdgeTable();
+}
+
+
+void Mesh::RemoveFaces(const std::vector<IdType> &ids){
+
+    RemoveFaces(MaskFromIds(ids, last_face_id_ + 1));
+}
+
+
+void Mesh::ReindexIds(std::vector<IdType> *vertex_remap, std::vector<IdType> *face_remap){
+
+    // Assign ids sequentially to vertices. The nodes of the container are
+    // moved to a new container with their keys updated, so no element is
+    // copied or reallocated
+    if (vertex_remap != NULL){
+        vertex_remap->assign(last_vertex_id_ + 1, -1);
+    }
+    VertexContainer reindexed_vertex;
+    IdType id = 0;
+    while (!vertex_.empty()){
+        VertexContainer::node_type node = vertex_.extract(vertex_.begin());
+        if (vertex_remap != NULL){
+            (*vertex_remap)[node.key()] = id;
+        }
+        node.key() = id;
+        node.mapped()->id_ = id;
+        reindexed_vertex.insert(reindexed_vertex.end(), std::move(node));
+        id++;
+    }
+    vertex_.swap(reindexed_vertex);
+    last_vertex_id_ = id - 1;
+
+    // Assign ids sequentially to faces
+    if (face_remap != NULL){
+        face_remap->assign(last_face_id_ + 1, -1);
+    }
+    FaceContainer reindexed_face;
+    id = 0;
+    while (!face_.empty()){
+        FaceContainer::node_type node = face_.extract(face_.begin());
+        if (face_remap != NULL){
+            (*face_remap)[node.key()] = id;
+        }
+        node.key() = id;
+        node.mapped()->id_ = id;
+        reindexed_face.insert(reindexed_face.end(), std::move(node));
+        id++;
+    }
+    face_.swap(reindexed_face);
+    last_face_id_ = id - 1;
+
+    // Release the tables, which are rebuilt on demand
+    TopologyChanged();
+    vertex_face_table_ = VertexFaceTable();
+    edge_table_ = EdgeTable();
 }
 
 
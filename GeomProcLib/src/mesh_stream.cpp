@@ -0,0 +1,459 @@
+#include <mesh_stream.h>
+#include <utils.h>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <exception>
+
+
+namespace GeomProc {
+
+
+// Initial size of the window of the file
+static const size_t StreamWindowSize = 1 << 20;
+
+
+MeshStreamReader::MeshStreamReader(void){
+
+    format_ = StreamObj;
+    block_size_ = 0;
+    begin_ = 0;
+    end_ = 0;
+    eof_ = false;
+    vertex_count_ = 0;
+    face_count_ = 0;
+    off_vertex_count_ = 0;
+    off_face_count_ = 0;
+    off_faces_read_ = 0;
+    ply_element_ = 0;
+    ply_record_ = 0;
+    ply_swap_ = false;
+}
+
+
+MeshStreamReader::~MeshStreamReader(){
+
+    Close();
+}
+
+
+void MeshStreamReader::Open(const char *filename, size_t block_size){
+
+    Close();
+
+    // Get format from the extension
+    std::string fn = std::string(filename);
+    std::string ext = mesh_extension(fn);
+    if ((ext == std::string("obj")) ||
+        (ext == std::string("OBJ"))){
+        format_ = StreamObj;
+    } else if ((ext == std::string("off")) ||
+               (ext == std::string("OFF"))){
+        format_ = StreamOff;
+    } else if ((ext == std::string("ply")) ||
+               (ext == std::string("PLY"))){
+        format_ = StreamPly;
+    } else {
+        throw(std::ios_base::failure(std::string("Error: extension \"")+ext+std::string("\" not supported")));
+    }
+
+    // Open file, which throws an exception on errors
+    stream_.Open(filename);
+    filename_ = filename;
+    block_size_ = std::max<size_t>(block_size, 1);
+    buffer_.resize(StreamWindowSize);
+    begin_ = 0;
+    end_ = 0;
+    eof_ = false;
+    vertex_count_ = 0;
+    face_count_ = 0;
+
+    ReadHeader();
+}
+
+
+void MeshStreamReader::Close(void){
+
+    stream_.Close();
+    buffer_.clear();
+    begin_ = 0;
+    end_ = 0;
+}
+
+
+bool MeshStreamReader::Fill(size_t size){
+
+    while (end_ - begin_ < size){
+        if (eof_){
+            return false;
+        }
+        // Move the unread bytes to the start of the window, and grow the
+        // window if it is full
+        if (begin_ > 0){
+            memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buffer_.size()){
+            buffer_.resize(2*buffer_.size());
+        }
+        size_t count = stream_.Read(buffer_.data() + end_, buffer_.size() - end_);
+        if (count == 0){
+            eof_ = true;
+        }
+        end_ += count;
+    }
+    return true;
+}
+
+
+bool MeshStreamReader::NextLine(const char *&line, const char *&line_end){
+
+    size_t scanned = 0;
+    while (true){
+        const char *p = buffer_.data() + begin_;
+        const char *eol = (const char *) memchr(p + scanned, '\n', end_ - begin_ - scanned);
+        if (eol != NULL){
+            line = p;
+            line_end = eol;
+            begin_ = eol + 1 - buffer_.data();
+            break;
+        }
+        scanned = end_ - begin_;
+        if (!Fill(scanned + 1)){
+            // The last line may not end with a line break
+            if (end_ == begin_){
+                return false;
+            }
+            line = buffer_.data() + begin_;
+            line_end = buffer_.data() + end_;
+            begin_ = end_;
+            break;
+        }
+    }
+    if ((line_end > line) && (line_end[-1] == '\r')){
+        line_end--;
+    }
+    return true;
+}
+
+
+double MeshStreamReader::NextPlyValue(PlyType type){
+
+    if (ply_header_.format != PlyAscii){
+        size_t size = ply_type_size(type);
+        if (!Fill(size)){
+            throw(std::ios_base::failure(std::string("Error: file too short")));
+        }
+        double value = ply_binary_value(buffer_.data() + begin_, type, ply_swap_);
+        begin_ += size;
+        return value;
+    }
+
+    // Skip white space, including line breaks
+    while (true){
+        if (!Fill(1)){
+            throw(std::ios_base::failure(std::string("Error: file too short")));
+        }
+        char c = buffer_[begin_];
+        if ((c != ' ') && (c != '\t') && (c != '\r') && (c != '\n')){
+            break;
+        }
+        begin_++;
+    }
+    // Find the end of the token, which may be at the end of the file
+    size_t length = 0;
+    while (true){
+        if ((begin_ + length == end_) && (!Fill(length + 1))){
+            break;
+        }
+        char c = buffer_[begin_ + length];
+        if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')){
+            break;
+        }
+        length++;
+    }
+    const char *token = buffer_.data() + begin_;
+    double value;
+    std::from_chars_result result = std::from_chars((*token == '+') ? token+1 : token, token + length, value);
+    if (result.ec != std::errc()){
+        throw(std::ios_base::failure(std::string("Invalid number: ")+std::string(token, length)));
+    }
+    begin_ += length;
+    return value;
+}
+
+
+void MeshStreamReader::AddPolygon(MeshBlock &block){
+
+    if (polygon_.size() < 3){
+        throw(std::ios_base::failure(std::string("Error: faces need to have at least 3 vertices")));
+    }
+    // Break polygons into a fan of triangles
+    for (size_t k = 1; k + 1 < polygon_.size(); k++){
+        block.index.push_back(polygon_[0]);
+        block.index.push_back(polygon_[k]);
+        block.index.push_back(polygon_[k+1]);
+    }
+}
+
+
+void MeshStreamReader::ReadHeader(void){
+
+    const char *line, *line_end;
+    if (format_ == StreamOff){
+        // Read file format identifier
+        if ((!NextLine(line, line_end)) || (line_end - line < 3) || (memcmp(line, "OFF", 3) != 0)){
+            throw(std::ios_base::failure(std::string("Error opening file ")+filename_+std::string(". File does not have the OFF identifier")));
+        }
+        // Read mesh attributes, skipping empty lines and comments
+        const char *p;
+        do {
+            if (!NextLine(line, line_end)){
+                throw(std::ios_base::failure(std::string("Error: file too short")));
+            }
+            p = skip_blanks(line, line_end);
+        } while ((p == line_end) || (*p == '#'));
+        int num_vertices, num_faces;
+        p = parse_int(p, line_end, num_vertices);
+        p = parse_int(skip_blanks(p, line_end), line_end, num_faces);
+        if ((num_vertices < 0) || (num_faces < 0)){
+            throw(std::ios_base::failure(std::string("Error: invalid element counts")));
+        }
+        off_vertex_count_ = num_vertices;
+        off_face_count_ = num_faces;
+        off_faces_read_ = 0;
+    } else if (format_ == StreamPly){
+        // Collect the header lines and parse them
+        std::string header;
+        while (true){
+            if (!NextLine(line, line_end)){
+                throw(std::ios_base::failure(std::string("Error: ply header is incomplete")));
+            }
+            header.append(line, line_end);
+            header.push_back('\n');
+            line = skip_blanks(line, line_end);
+            if ((line_end - line >= 10) && (memcmp(line, "end_header", 10) == 0)){
+                break;
+            }
+        }
+        parse_ply_header(header.data(), header.data() + header.size(), ply_header_);
+        ply_element_ = 0;
+        ply_record_ = 0;
+        ply_swap_ = (ply_header_.format != PlyAscii) && ((ply_header_.format == PlyBinaryLittleEndian) != host_is_little_endian());
+    }
+}
+
+
+bool MeshStreamReader::ReadBlock(MeshBlock &block){
+
+    block.first_vertex = vertex_count_;
+    block.first_face = face_count_;
+    block.position.clear();
+    block.color.clear();
+    block.index.clear();
+    if (!stream_.IsOpen()){
+        return false;
+    }
+
+    if (format_ == StreamObj){
+        ReadObjBlock(block);
+    } else if (format_ == StreamOff){
+        ReadOffBlock(block);
+    } else {
+        ReadPlyBlock(block);
+    }
+
+    // Vertices without a color get black, like in a Mesh
+    if (block.color.size() > 0){
+        block.color.resize(block.position.size(), ColorType(0.0, 0.0, 0.0));
+    }
+    vertex_count_ += block.VertexCount();
+    face_count_ += block.FaceCount();
+    return (block.VertexCount() > 0) || (block.FaceCount() > 0);
+}
+
+
+void MeshStreamReader::ReadObjBlock(MeshBlock &block){
+
+    const char *line, *end;
+    while ((block.VertexCount() < block_size_) && (block.FaceCount() < block_size_)){
+        if (!NextLine(line, end)){
+            break;
+        }
+        const char *p = skip_blanks(line, end);
+        const char *command_end = skip_token(p, end);
+        if ((command_end - p != 1) || ((*p != 'v') && (*p != 'f'))){
+            // Ignore comments and other commands
+            continue;
+        }
+        if (*p == 'v'){
+            // Position, optionally followed by a color
+            PositionType pos;
+            p = command_end;
+            for (int j = 0; j < 3; j++){
+                p = parse_float(skip_blanks(p, end), end, pos[j]);
+            }
+            block.position.push_back(pos);
+            p = skip_blanks(p, end);
+            if (p < end){
+                ColorType color;
+                for (int j = 0; j < 3; j++){
+                    p = parse_float(skip_blanks(p, end), end, color[j]);
+                }
+                block.color.resize(block.position.size() - 1, ColorType(0.0, 0.0, 0.0));
+                block.color.push_back(color);
+            }
+        } else {
+            // Only the position index of each face vertex is used
+            polygon_.clear();
+            p = skip_blanks(command_end, end);
+            while (p < end){
+                int index;
+                parse_int(p, end, index);
+                p = skip_blanks(skip_token(p, end), end);
+                long long vertex = (index < 0) ? ((long long) (vertex_count_ + block.VertexCount())) + index : index - 1;
+                if (vertex < 0){
+                    throw(std::ios_base::failure(std::string("Error: index for triangle ")+num_to_str<int>(index)+std::string(" is out of bounds")));
+                }
+                polygon_.push_back(vertex);
+            }
+            AddPolygon(block);
+        }
+    }
+}
+
+
+void MeshStreamReader::ReadOffBlock(MeshBlock &block){
+
+    const char *line, *end;
+    while ((block.VertexCount() < block_size_) && (block.FaceCount() < block_size_)){
+        bool vertex = (vertex_count_ + block.VertexCount() < off_vertex_count_);
+        if ((!vertex) && (off_faces_read_ == off_face_count_)){
+            break;
+        }
+        // Skip empty lines
+        const char *p;
+        do {
+            if (!NextLine(line, end)){
+                throw(std::ios_base::failure(std::string("Error: file too short")));
+            }
+            p = skip_blanks(line, end);
+        } while (p == end);
+
+        if (vertex){
+            PositionType pos;
+            for (int j = 0; j < 3; j++){
+                p = parse_float(skip_blanks(p, end), end, pos[j]);
+            }
+            block.position.push_back(pos);
+        } else {
+            int count, index;
+            p = parse_int(p, end, count);
+            polygon_.clear();
+            for (int k = 0; k < count; k++){
+                p = parse_int(skip_blanks(p, end), end, index);
+                if ((index < 0) || (index >= (int) off_vertex_count_)){
+                    throw(std::ios_base::failure(std::string("Error: index of vertex in face "+num_to_str<size_t>(off_faces_read_)+std::string(" out of range"))));
+                }
+                polygon_.push_back(index);
+            }
+            AddPolygon(block);
+            off_faces_read_++;
+        }
+    }
+}
+
+
+void MeshStreamReader::ReadPlyBlock(MeshBlock &block){
+
+    // Properties of the current element that are used
+    int layout_element = -1;
+    int position[3] = {-1, -1, -1};
+    int color[3] = {-1, -1, -1};
+    float color_scale = 1.0;
+    int index_property = -1;
+    size_t vertex_total = 0;
+    std::vector<double> value;
+
+    while ((ply_element_ < ply_header_.element.size()) &&
+           (block.VertexCount() < block_size_) && (block.FaceCount() < block_size_)){
+        const PlyElement &element = ply_header_.element[ply_element_];
+        if (ply_record_ == element.count){
+            ply_element_++;
+            ply_record_ = 0;
+            continue;
+        }
+
+        // Find the properties of the element
+        if (layout_element != (int) ply_element_){
+            layout_element = ply_element_;
+            value.resize(element.property.size());
+            if (element.name == "vertex"){
+                position[0] = element.FindProperty("x");
+                position[1] = element.FindProperty("y");
+                position[2] = element.FindProperty("z");
+                if ((position[0] < 0) || (position[1] < 0) || (position[2] < 0)){
+                    throw(std::ios_base::failure(std::string("Error: ply vertex element needs x, y, and z properties")));
+                }
+                color[0] = element.FindProperty("red");
+                color[1] = element.FindProperty("green");
+                color[2] = element.FindProperty("blue");
+                if ((color[0] >= 0) && (color[1] >= 0) && (color[2] >= 0)){
+                    color_scale = ply_color_scale(element.property[color[0]].type);
+                } else {
+                    color[0] = -1;
+                }
+            } else if (element.name == "face"){
+                index_property = element.FindProperty("vertex_indices");
+                if (index_property < 0){
+                    index_property = element.FindProperty("vertex_index");
+                }
+                if ((index_property < 0) || (element.property[index_property].count_type == PlyNone)){
+                    throw(std::ios_base::failure(std::string("Error: ply face element needs a vertex_indices list")));
+                }
+                for (unsigned int e = 0; e < ply_header_.element.size(); e++){
+                    if (ply_header_.element[e].name == "vertex"){
+                        vertex_total = ply_header_.element[e].count;
+                    }
+                }
+            }
+        }
+
+        // Read one record
+        polygon_.clear();
+        for (int j = 0; j < (int) element.property.size(); j++){
+            const PlyProperty &property = element.property[j];
+            if (property.count_type == PlyNone){
+                value[j] = NextPlyValue(property.type);
+                continue;
+            }
+            int items = NextPlyValue(property.count_type);
+            for (int k = 0; k < items; k++){
+                double item = NextPlyValue(property.type);
+                if ((element.name == "face") && (j == index_property)){
+                    polygon_.push_back(item);
+                }
+            }
+        }
+        ply_record_++;
+
+        // Store the elements that are used
+        if (element.name == "vertex"){
+            block.position.push_back(PositionType(value[position[0]], value[position[1]], value[position[2]]));
+            if (color[0] >= 0){
+                block.color.push_back(ColorType(value[color[0]], value[color[1]], value[color[2]])*color_scale);
+            }
+        } else if (element.name == "face"){
+            for (unsigned int k = 0; k < polygon_.size(); k++){
+                if ((polygon_[k] < 0) || (polygon_[k] >= (int) vertex_total)){
+                    throw(std::ios_base::failure(std::string("Error: index of vertex in face ")+num_to_str<size_t>(ply_record_-1)+std::string(" out of range")));
+                }
+            }
+            AddPolygon(block);
+        }
+    }
+}
+
+
+} // namespace GeomProc
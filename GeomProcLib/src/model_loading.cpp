@@ -0,0 +1,1292 @@
+#include <model_loading.h>
+#include <utils.h>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace GeomProc {
+
+
+MappedFile::MappedFile(void){
+
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+}
+
+
+MappedFile::~MappedFile(){
+
+    Close();
+}
+
+
+void MappedFile::Open(const char *filename){
+
+    Close();
+
+    // Decompress compressed files into memory
+    if (file_compression(filename) != NoCompression){
+        InputStream stream;
+        stream.Open(filename);
+        size_t count;
+        do {
+            buffer_.resize(size_ + (1 << 22));
+            count = stream.Read(buffer_.data() + size_, buffer_.size() - size_);
+            size_ += count;
+        } while (size_ == buffer_.size());
+        buffer_.resize(size_);
+        data_ = buffer_.data();
+        return;
+    }
+
+#ifndef _WIN32
+    // Map the whole file into memory
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        close(fd);
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    size_ = st.st_size;
+    if (size_ > 0){
+        void *addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED){
+            close(fd);
+            size_ = 0;
+            throw(std::ios_base::failure(std::string("Error mapping file ")+std::string(filename)));
+        }
+        // The file is usually read from beginning to end
+        madvise(addr, size_, MADV_SEQUENTIAL);
+        data_ = (const char *) addr;
+        mapped_ = true;
+    }
+    close(fd);
+#else
+    // Read the whole file into memory
+    std::ifstream f;
+    f.open(filename, std::ios::binary);
+    if (f.fail()){
+        throw(std::ios_base::failure(std::string("Error opening file ")+std::string(filename)));
+    }
+    f.seekg(0, std::ios::end);
+    buffer_.resize(f.tellg());
+    f.seekg(0, std::ios::beg);
+    f.read(buffer_.data(), buffer_.size());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+
+void MappedFile::Close(void){
+
+#ifndef _WIN32
+    if (mapped_){
+        munmap((void *) data_, size_);
+    }
+#endif
+    buffer_.clear();
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+}
+
+
+// Size of the blocks written to the file
+static const size_t OutputBlockSize = 1 << 20;
+
+
+OutputBuffer::OutputBuffer(int precision){
+
+    size_ = 0;
+    // Limit the precision so that a float always fits the space reserved
+    // by WriteFloat
+    precision_ = std::min(std::max(precision, 1), 40);
+}
+
+
+OutputBuffer::~OutputBuffer(){
+}
+
+
+void OutputBuffer::Open(const char *filename){
+
+    file_.Open(filename);
+    buffer_.resize(OutputBlockSize);
+    size_ = 0;
+}
+
+
+void OutputBuffer::Close(void){
+
+    if (!file_.IsOpen()){
+        return;
+    }
+    Flush();
+    file_.Close();
+}
+
+
+void OutputBuffer::Flush(void){
+
+    if (file_.IsOpen() && (size_ > 0)){
+        file_.Write(buffer_.data(), size_);
+        size_ = 0;
+    }
+}
+
+
+void OutputBuffer::Reserve(size_t size){
+
+    if (size_ + size <= buffer_.size()){
+        return;
+    }
+    Flush();
+    if (size_ + size > buffer_.size()){
+        buffer_.resize(std::max(std::max(2*buffer_.size(), size_ + size), (size_t) 256));
+    }
+}
+
+
+void OutputBuffer::Write(const char *str){
+
+    Write(str, strlen(str));
+}
+
+
+void OutputBuffer::Write(const char *str, size_t size){
+
+    // Write large blocks of text directly to the file
+    if (file_.IsOpen() && (size >= buffer_.size())){
+        Flush();
+        file_.Write(str, size);
+        return;
+    }
+    Reserve(size);
+    memcpy(buffer_.data() + size_, str, size);
+    size_ += size;
+}
+
+
+void OutputBuffer::Write(char c){
+
+    Reserve(1);
+    buffer_[size_++] = c;
+}
+
+
+void OutputBuffer::WriteInt(long long value){
+
+    Reserve(32);
+    char *p = buffer_.data() + size_;
+    size_ = std::to_chars(p, p + 32, value).ptr - buffer_.data();
+}
+
+
+void OutputBuffer::WriteFloat(float value){
+
+    Reserve(64);
+    char *p = buffer_.data() + size_;
+    size_ = std::to_chars(p, p + 64, value, std::chars_format::general, precision_).ptr - buffer_.data();
+}
+
+
+size_t binary_mesh_array_size(const BinaryMeshHeader &header, int array){
+
+    size_t v = header.vertex_count;
+    size_t f = header.face_count;
+    switch (array){
+        case BinaryPosition:
+        case BinaryVertexNormal:
+        case BinaryVertexColor:
+            return 3*v*sizeof(float);
+        case BinaryVertexUV:
+            return 2*v*sizeof(float);
+        case BinaryIndex:
+            return 3*f*sizeof(int);
+        case BinaryFaceNormal:
+            return 3*f*sizeof(float);
+        case BinaryFaceArea:
+            return f*sizeof(float);
+        case BinaryCornerNormal:
+            return 9*f*sizeof(float);
+        case BinaryCornerUV:
+            return 6*f*sizeof(float);
+        case BinaryVertexFaceOffset:
+            return (v+1)*sizeof(int);
+        case BinaryVertexFace:
+            return header.vertex_face_count*sizeof(int);
+        default:
+            return 0;
+    }
+}
+
+
+const char *parse_float(const char *begin, const char *end, float &value){
+
+    // from_chars does not accept an explicit plus sign
+    const char *p = begin;
+    if ((p < end) && (*p == '+')){
+        p++;
+    }
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec == std::errc::result_out_of_range){
+        // Values too small or too large for a float are rounded to the
+        // nearest float, as done by the compiler for literals
+        double dvalue;
+        result = std::from_chars(p, end, dvalue);
+        value = (float) dvalue;
+    }
+    if (result.ec != std::errc()){
+        throw(std::ios_base::failure(std::string("Invalid number: ")+std::string(begin, skip_token(begin, end))));
+    }
+    return result.ptr;
+}
+
+
+const char *parse_int(const char *begin, const char *end, int &value){
+
+    // from_chars does not accept an explicit plus sign
+    const char *p = begin;
+    if ((p < end) && (*p == '+')){
+        p++;
+    }
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()){
+        throw(std::ios_base::failure(std::string("Invalid number: ")+std::string(begin, skip_token(begin, end))));
+    }
+    return result.ptr;
+}
+
+
+// Convert an obj index into a 0-based absolute index. Negative indices
+// are relative to the number of elements read so far
+static int resolve_obj_index(int index, int count){
+
+    if (index < 0){
+        return count + index;
+    }
+    return index - 1;
+}
+
+
+// Parse one vertex of an f command, in the form i, i/t, i//n, or i/t/n
+static void parse_obj_face_vertex(const char *begin, const char *end, const ObjChunk &chunk, int attributes, int &i, int &t, int &n, unsigned short &relative){
+
+    // Split the vertex into fields separated by '/'
+    const char *field[3];
+    const char *field_end[3];
+    int count = 0;
+    const char *p = begin;
+    while (true){
+        if (count == 3){
+            throw(std::ios_base::failure(std::string("Error: f parameter should have 1, 2, or 3 parameters separated by '/'")));
+        }
+        field[count] = p;
+        while ((p < end) && (*p != '/')){
+            p++;
+        }
+        field_end[count] = p;
+        count++;
+        if (p == end){
+            break;
+        }
+        p++;
+    }
+
+    // Parse the fields
+    // Bits 0, 1, and 2 of relative are set for relative i, t, and n
+    int value;
+    relative = 0;
+    parse_int(field[0], field_end[0], value);
+    i = resolve_obj_index(value, chunk.position.size());
+    relative |= (value < 0) ? 1 : 0;
+    t = -1;
+    n = -1;
+    if ((attributes & AttributeUV) && ((count == 2) || ((count == 3) && (field[1] != field_end[1])))){
+        parse_int(field[1], field_end[1], value);
+        t = resolve_obj_index(value, chunk.uv.size());
+        relative |= (value < 0) ? 2 : 0;
+    }
+    if ((attributes & AttributeNormal) && (count == 3)){
+        parse_int(field[2], field_end[2], value);
+        n = resolve_obj_index(value, chunk.normal.size());
+        relative |= (value < 0) ? 4 : 0;
+    }
+}
+
+
+void parse_obj(const char *begin, const char *end, ObjChunk &chunk, int attributes){
+
+    // Go through each line of the text without copying it
+    const char *line = begin;
+    while (line < end){
+        // Find the extent of the line, without the whitespace at its
+        // extremities
+        const char *eol = (const char *) memchr(line, '\n', end - line);
+        if (eol == NULL){
+            eol = end;
+        }
+        const char *next = eol + 1;
+        const char *p = skip_blanks(line, eol);
+        const char *last = eol;
+        while ((last > p) && ((last[-1] == ' ') || (last[-1] == '\t') || (last[-1] == '\r'))){
+            last--;
+        }
+        line = next;
+
+        // Ignore empty lines and comments
+        if ((p == last) || (*p == '#')){
+            continue;
+        }
+
+        // Check command in the line
+        const char *command_end = skip_token(p, last);
+        size_t command_size = command_end - p;
+        p = skip_blanks(command_end, last);
+        if ((command_size == 1) && (command_end[-1] == 'v') && (!(attributes & AttributeColor))){
+            // Read only the position
+            PositionType pos;
+            for (int j = 0; j < 3; j++){
+                if (p == last){
+                    throw(std::ios_base::failure(std::string("Error: v command should have exactly 3 or 6 parameters")));
+                }
+                const char *token_end = skip_token(p, last);
+                parse_float(p, token_end, pos[j]);
+                p = skip_blanks(token_end, last);
+            }
+            chunk.position.push_back(pos);
+        } else if ((command_size == 1) && (command_end[-1] == 'v')){
+            // Read up to 6 numbers
+            float value[6];
+            int count = 0;
+            while (p < last){
+                if (count == 6){
+                    count++;
+                    break;
+                }
+                const char *token_end = skip_token(p, last);
+                parse_float(p, token_end, value[count]);
+                count++;
+                p = skip_blanks(token_end, last);
+            }
+            if (count == 3){
+                chunk.position.push_back(PositionType(value[0], value[1], value[2]));
+                if (chunk.color.size() > 0){
+                    chunk.color.push_back(ColorType());
+                }
+            } else if (count == 6){
+                // Colors are only stored once a vertex with a color is found
+                chunk.color.resize(chunk.position.size());
+                chunk.position.push_back(PositionType(value[0], value[1], value[2]));
+                chunk.color.push_back(ColorType(value[3], value[4], value[5]));
+            } else {
+                throw(std::ios_base::failure(std::string("Error: v command should have exactly 3 or 6 parameters")));
+            }
+        } else if ((command_size == 2) && (command_end[-2] == 'v') && (command_end[-1] == 'n')){
+            if (!(attributes & AttributeNormal)){
+                continue;
+            }
+            float value[3];
+            int count = 0;
+            while ((p < last) && (count < 4)){
+                const char *token_end = skip_token(p, last);
+                if (count < 3){
+                    parse_float(p, token_end, value[count]);
+                }
+                count++;
+                p = skip_blanks(token_end, last);
+            }
+            if (count != 3){
+                throw(std::ios_base::failure(std::string("Error: vn command should have exactly 3 parameters")));
+            }
+            chunk.normal.push_back(NormalType(value[0], value[1], value[2]));
+        } else if ((command_size == 2) && (command_end[-2] == 'v') && (command_end[-1] == 't')){
+            if (!(attributes & AttributeUV)){
+                continue;
+            }
+            float value[2];
+            int count = 0;
+            while ((p < last) && (count < 3)){
+                const char *token_end = skip_token(p, last);
+                if (count < 2){
+                    parse_float(p, token_end, value[count]);
+                }
+                count++;
+                p = skip_blanks(token_end, last);
+            }
+            if (count != 2){
+                throw(std::ios_base::failure(std::string("Error: vt command should have exactly 2 parameters")));
+            }
+            chunk.uv.push_back(UVType(value[0], value[1]));
+        } else if ((command_size == 1) && (command_end[-1] == 'f')){
+            // Read up to 4 vertices
+            TempQuad quad;
+            unsigned short relative[4];
+            int count = 0;
+            while (p < last){
+                if (count == 4){
+                    throw(std::ios_base::failure(std::string("Error: f commands with more than 4 vertices not supported")));
+                }
+                const char *token_end = skip_token(p, last);
+                parse_obj_face_vertex(p, token_end, chunk, attributes, quad.i[count], quad.t[count], quad.n[count], relative[count]);
+                count++;
+                p = skip_blanks(token_end, last);
+            }
+            if (count < 3){
+                throw(std::ios_base::failure(std::string("Error: f command should have 3 or 4 parameters")));
+            }
+            // Add the triangle, or break the quad into two triangles
+            int corner[2][3] = {{0, 1, 2}, {0, 2, 3}};
+            for (int j = 0; j < count - 2; j++){
+                TempFace face;
+                unsigned short mask = 0;
+                for (int k = 0; k < 3; k++){
+                    int c = corner[j][k];
+                    face.i[k] = quad.i[c];
+                    face.n[k] = quad.n[c];
+                    face.t[k] = quad.t[c];
+                    mask |= ((relative[c] & 1) << k) | (((relative[c] >> 1) & 1) << (3+k)) | (((relative[c] >> 2) & 1) << (6+k));
+                }
+                if (mask != 0){
+                    chunk.relative.push_back(std::make_pair((unsigned int) chunk.face.size(), mask));
+                }
+                chunk.face.push_back(face);
+            }
+        }
+        // Ignore other commands
+    }
+}
+
+
+// Resolve relative indices of the chunks against the elements of the
+// preceding chunks
+static void resolve_obj_chunks(std::vector<ObjChunk> &chunk){
+
+    size_t count = chunk.size();
+    int position_offset = 0;
+    int uv_offset = 0;
+    int normal_offset = 0;
+    for (size_t c = 0; c < count; c++){
+        for (unsigned int r = 0; r < chunk[c].relative.size(); r++){
+            TempFace &face = chunk[c].face[chunk[c].relative[r].first];
+            unsigned short mask = chunk[c].relative[r].second;
+            for (int k = 0; k < 3; k++){
+                face.i[k] += (mask & (1 << k)) ? position_offset : 0;
+                face.t[k] += (mask & (1 << (3+k))) ? uv_offset : 0;
+                face.n[k] += (mask & (1 << (6+k))) ? normal_offset : 0;
+            }
+        }
+        chunk[c].relative.clear();
+        position_offset += chunk[c].position.size();
+        uv_offset += chunk[c].uv.size();
+        normal_offset += chunk[c].normal.size();
+    }
+}
+
+
+void parse_obj_chunks(const char *begin, const char *end, std::vector<ObjChunk> &chunk, int attributes){
+
+    // Choose the number of chunks so that each one has a reasonable size
+    const size_t min_chunk_size = 1 << 20;
+    size_t size = end - begin;
+    size_t count = std::min<size_t>(get_num_threads(), size/min_chunk_size);
+    if (count < 1){
+        count = 1;
+    }
+
+    // Find chunk boundaries, moving each boundary to the next line
+    std::vector<const char *> bound(count+1);
+    bound[0] = begin;
+    bound[count] = end;
+    for (size_t c = 1; c < count; c++){
+        const char *p = begin + (size*c)/count;
+        if (p < bound[c-1]){
+            p = bound[c-1];
+        }
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        bound[c] = (eol == NULL) ? end : eol + 1;
+    }
+
+    // Parse the chunks in parallel
+    chunk.clear();
+    chunk.resize(count);
+    parallel_invoke(count, [&](int c){
+        parse_obj(bound[c], bound[c+1], chunk[c], attributes);
+    });
+    resolve_obj_chunks(chunk);
+}
+
+
+void parse_obj_stream(InputStream &stream, std::vector<ObjChunk> &chunk, int attributes){
+
+    // Read blocks of text and parse the whole lines of each block as a
+    // chunk, while the stream decodes the next blocks. The last partial
+    // line of a block is moved to the start of the next one
+    const size_t block_size = 1 << 22;
+    std::vector<char> text(block_size);
+    size_t size = 0;
+    chunk.clear();
+    while (true){
+        size_t count = stream.Read(text.data() + size, text.size() - size);
+        size += count;
+        bool last = (count == 0);
+        const char *end = text.data() + size;
+        if (!last){
+            // Find the end of the last whole line
+            while ((end > text.data()) && (end[-1] != '\n')){
+                end--;
+            }
+            if (end == text.data()){
+                // A single line fills the block, so grow it
+                text.resize(2*text.size());
+                continue;
+            }
+        }
+        chunk.push_back(ObjChunk());
+        parse_obj(text.data(), end, chunk.back(), attributes);
+        size_t rest = text.data() + size - end;
+        memmove(text.data(), end, rest);
+        size = rest;
+        if (last){
+            break;
+        }
+    }
+    resolve_obj_chunks(chunk);
+}
+
+
+int PlyElement::FindProperty(const char *name) const {
+
+    for (unsigned int i = 0; i < property.size(); i++){
+        if (property[i].name == name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+size_t PlyElement::RecordSize(void) const {
+
+    size_t size = 0;
+    for (unsigned int i = 0; i < property.size(); i++){
+        if (property[i].count_type != PlyNone){
+            return 0;
+        }
+        size += ply_type_size(property[i].type);
+    }
+    return size;
+}
+
+
+size_t ply_type_size(PlyType type){
+
+    switch (type){
+        case PlyInt8:
+        case PlyUInt8:
+            return 1;
+        case PlyInt16:
+        case PlyUInt16:
+            return 2;
+        case PlyInt32:
+        case PlyUInt32:
+        case PlyFloat32:
+            return 4;
+        case PlyFloat64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+
+// Get the ply type with the given name
+static PlyType ply_type_from_name(const std::string &name){
+
+    if ((name == "char") || (name == "int8")){
+        return PlyInt8;
+    } else if ((name == "uchar") || (name == "uint8")){
+        return PlyUInt8;
+    } else if ((name == "short") || (name == "int16")){
+        return PlyInt16;
+    } else if ((name == "ushort") || (name == "uint16")){
+        return PlyUInt16;
+    } else if ((name == "int") || (name == "int32")){
+        return PlyInt32;
+    } else if ((name == "uint") || (name == "uint32")){
+        return PlyUInt32;
+    } else if ((name == "float") || (name == "float32")){
+        return PlyFloat32;
+    } else if ((name == "double") || (name == "float64")){
+        return PlyFloat64;
+    }
+    throw(std::ios_base::failure(std::string("Error: ply type \"")+name+std::string("\" not supported")));
+}
+
+
+void parse_ply_header(const char *begin, const char *end, PlyHeader &header){
+
+    header.format = PlyAscii;
+    header.element.clear();
+    header.size = 0;
+
+    // Go through each line of the header
+    const char *line = begin;
+    bool first = true;
+    while (true){
+        const char *eol = (line < end) ? (const char *) memchr(line, '\n', end - line) : NULL;
+        if (eol == NULL){
+            throw(std::ios_base::failure(std::string("Error: ply header is incomplete")));
+        }
+        const char *last = eol;
+        while ((last > line) && ((last[-1] == '\r') || (last[-1] == ' ') || (last[-1] == '\t'))){
+            last--;
+        }
+        std::vector<std::string> part = string_split(std::string(line, last), std::string(" \t"));
+        line = eol + 1;
+
+        // Leading blanks give an empty first token, and blank lines have no
+        // tokens left, so they are skipped
+        part.erase(std::remove(part.begin(), part.end(), std::string()), part.end());
+        if (part.empty()){
+            continue;
+        }
+
+        // Check command in the line
+        if (first){
+            if (part[0] != "ply"){
+                throw(std::ios_base::failure(std::string("Error: file does not have the ply identifier")));
+            }
+            first = false;
+        } else if (part[0] == "format"){
+            if ((part.size() < 2) || (part[1] == "ascii")){
+                header.format = PlyAscii;
+            } else if (part[1] == "binary_little_endian"){
+                header.format = PlyBinaryLittleEndian;
+            } else if (part[1] == "binary_big_endian"){
+                header.format = PlyBinaryBigEndian;
+            } else {
+                throw(std::ios_base::failure(std::string("Error: ply format \"")+part[1]+std::string("\" not supported")));
+            }
+        } else if (part[0] == "element"){
+            if (part.size() != 3){
+                throw(std::ios_base::failure(std::string("Error: element command should have exactly 2 parameters")));
+            }
+            PlyElement element;
+            element.name = part[1];
+            element.count = str_to_num<size_t>(part[2]);
+            header.element.push_back(element);
+        } else if (part[0] == "property"){
+            if (header.element.size() == 0){
+                throw(std::ios_base::failure(std::string("Error: ply property declared before any element")));
+            }
+            PlyProperty property;
+            if ((part.size() == 5) && (part[1] == "list")){
+                property.count_type = ply_type_from_name(part[2]);
+                property.type = ply_type_from_name(part[3]);
+                property.name = part[4];
+            } else if (part.size() == 3){
+                property.count_type = PlyNone;
+                property.type = ply_type_from_name(part[1]);
+                property.name = part[2];
+            } else {
+                throw(std::ios_base::failure(std::string("Error: invalid ply property")));
+            }
+            header.element.back().property.push_back(property);
+        } else if (part[0] == "end_header"){
+            header.size = line - begin;
+            return;
+        }
+        // Ignore comments and other commands
+    }
+}
+
+
+// Check if the machine stores values in little-endian order
+bool host_is_little_endian(void){
+
+    unsigned int one = 1;
+    unsigned char byte;
+    memcpy(&byte, &one, 1);
+    return byte == 1;
+}
+
+
+double ply_binary_value(const char *p, PlyType type, bool swap){
+
+    unsigned char b[8];
+    size_t size = ply_type_size(type);
+    memcpy(b, p, size);
+    if (swap){
+        std::reverse(b, b + size);
+    }
+    switch (type){
+        case PlyInt8: { signed char v; memcpy(&v, b, 1); return v; }
+        case PlyUInt8: { unsigned char v; memcpy(&v, b, 1); return v; }
+        case PlyInt16: { short v; memcpy(&v, b, 2); return v; }
+        case PlyUInt16: { unsigned short v; memcpy(&v, b, 2); return v; }
+        case PlyInt32: { int v; memcpy(&v, b, 4); return v; }
+        case PlyUInt32: { unsigned int v; memcpy(&v, b, 4); return v; }
+        case PlyFloat32: { float v; memcpy(&v, b, 4); return v; }
+        case PlyFloat64: { double v; memcpy(&v, b, 8); return v; }
+        default: return 0.0;
+    }
+}
+
+
+double ply_color_scale(PlyType type){
+
+    switch (type){
+        case PlyInt8: return 1.0/127.0;
+        case PlyUInt8: return 1.0/255.0;
+        case PlyInt16: return 1.0/32767.0;
+        case PlyUInt16: return 1.0/65535.0;
+        case PlyInt32: return 1.0/2147483647.0;
+        case PlyUInt32: return 1.0/4294967295.0;
+        default: return 1.0;
+    }
+}
+
+
+// Sequential reader of the values of a ply file
+class PlyCursor {
+    public:
+        PlyCursor(const char *begin, const char *end, PlyFormat format){
+            p_ = begin;
+            end_ = end;
+            format_ = format;
+            swap_ = (format != PlyAscii) && ((format == PlyBinaryLittleEndian) != host_is_little_endian());
+        }
+
+        // Read the next value, which has the given type
+        double Read(PlyType type){
+            if (format_ == PlyAscii){
+                while ((p_ < end_) && ((*p_ == ' ') || (*p_ == '\t') || (*p_ == '\r') || (*p_ == '\n'))){
+                    p_++;
+                }
+                if (p_ >= end_){
+                    throw(std::ios_base::failure(std::string("Error: file too short")));
+                }
+                const char *token_end = skip_token(p_, end_);
+                double value;
+                std::from_chars_result result = std::from_chars((*p_ == '+') ? p_+1 : p_, token_end, value);
+                if (result.ec != std::errc()){
+                    throw(std::ios_base::failure(std::string("Invalid number: ")+std::string(p_, token_end)));
+                }
+                p_ = token_end;
+                return value;
+            }
+            size_t size = ply_type_size(type);
+            if (p_ + size > end_){
+                throw(std::ios_base::failure(std::string("Error: file too short")));
+            }
+            double value = ply_binary_value(p_, type, swap_);
+            p_ += size;
+            return value;
+        }
+
+        // Skip the values of a binary record of the given size
+        void Skip(size_t size){
+            if ((size_t) (end_ - p_) < size){
+                throw(std::ios_base::failure(std::string("Error: file too short")));
+            }
+            p_ += size;
+        }
+
+        const char *Position(void) const { return p_; }
+        bool Swap(void) const { return swap_; }
+
+    private:
+        const char *p_;
+        const char *end_;
+        PlyFormat format_;
+        bool swap_;
+};
+
+
+// Properties of the ply vertex element that are stored in the mesh
+struct PlyVertexLayout {
+    int position[3];
+    int normal[3];
+    int color[3];
+    int uv[2];
+    double color_scale;
+};
+
+
+// Find the first property of element with one of the given names
+static int find_ply_property(const PlyElement &element, const char *name1, const char *name2 = NULL, const char *name3 = NULL){
+
+    int index = element.FindProperty(name1);
+    if ((index < 0) && (name2 != NULL)){
+        index = element.FindProperty(name2);
+    }
+    if ((index < 0) && (name3 != NULL)){
+        index = element.FindProperty(name3);
+    }
+    return index;
+}
+
+
+// Store the property values of vertex i in data
+static void store_ply_vertex(const PlyVertexLayout &layout, const double *value, size_t i, PlyData &data){
+
+    data.position[i] = PositionType(value[layout.position[0]], value[layout.position[1]], value[layout.position[2]]);
+    if (layout.normal[0] >= 0){
+        data.normal[i] = NormalType(value[layout.normal[0]], value[layout.normal[1]], value[layout.normal[2]]);
+    }
+    if (layout.color[0] >= 0){
+        data.color[i] = ColorType(value[layout.color[0]], value[layout.color[1]], value[layout.color[2]])*((float) layout.color_scale);
+    }
+    if (layout.uv[0] >= 0){
+        data.uv[i] = UVType(value[layout.uv[0]], value[layout.uv[1]]);
+    }
+}
+
+
+// Read the vertex element of a ply file
+static void parse_ply_vertices(const PlyElement &element, PlyFormat format, int attributes, PlyCursor &cursor, PlyData &data){
+
+    // Find properties
+    PlyVertexLayout layout;
+    layout.position[0] = find_ply_property(element, "x");
+    layout.position[1] = find_ply_property(element, "y");
+    layout.position[2] = find_ply_property(element, "z");
+    layout.normal[0] = find_ply_property(element, "nx");
+    layout.normal[1] = find_ply_property(element, "ny");
+    layout.normal[2] = find_ply_property(element, "nz");
+    layout.color[0] = find_ply_property(element, "red", "diffuse_red");
+    layout.color[1] = find_ply_property(element, "green", "diffuse_green");
+    layout.color[2] = find_ply_property(element, "blue", "diffuse_blue");
+    layout.uv[0] = find_ply_property(element, "u", "s", "texture_u");
+    layout.uv[1] = find_ply_property(element, "v", "t", "texture_v");
+    if ((layout.position[0] < 0) || (layout.position[1] < 0) || (layout.position[2] < 0)){
+        throw(std::ios_base::failure(std::string("Error: ply vertex element needs x, y, and z properties")));
+    }
+    if ((layout.normal[0] < 0) || (layout.normal[1] < 0) || (layout.normal[2] < 0) || (!(attributes & AttributeNormal))){
+        layout.normal[0] = -1;
+    }
+    if ((layout.color[0] < 0) || (layout.color[1] < 0) || (layout.color[2] < 0) || (!(attributes & AttributeColor))){
+        layout.color[0] = -1;
+    }
+    if ((layout.uv[0] < 0) || (layout.uv[1] < 0) || (!(attributes & AttributeUV))){
+        layout.uv[0] = -1;
+    }
+    layout.color_scale = 1.0;
+    if (layout.color[0] >= 0){
+        layout.color_scale = ply_color_scale(element.property[layout.color[0]].type);
+    }
+
+    // Allocate attributes
+    size_t first = data.position.size();
+    size_t count = element.count;
+    data.position.resize(first + count);
+    if (layout.normal[0] >= 0){
+        data.normal.resize(first + count);
+    }
+    if (layout.color[0] >= 0){
+        data.color.resize(first + count);
+    }
+    if (layout.uv[0] >= 0){
+        data.uv.resize(first + count);
+    }
+
+    size_t property_count = element.property.size();
+    size_t record_size = element.RecordSize();
+    if ((format != PlyAscii) && (record_size > 0)){
+        // Records of binary files without lists have a fixed size, so
+        // they can be decoded in parallel
+        std::vector<size_t> offset(property_count);
+        for (size_t j = 1; j < property_count; j++){
+            offset[j] = offset[j-1] + ply_type_size(element.property[j-1].type);
+        }
+        const char *records = cursor.Position();
+        cursor.Skip(record_size*count);
+        bool swap = cursor.Swap();
+        parallel_for(0, count, [&](size_t begin, size_t end){
+            std::vector<double> value(property_count);
+            for (size_t i = begin; i < end; i++){
+                const char *record = records + i*record_size;
+                for (size_t j = 0; j < property_count; j++){
+                    value[j] = ply_binary_value(record + offset[j], element.property[j].type, swap);
+                }
+                store_ply_vertex(layout, value.data(), first + i, data);
+            }
+        });
+    } else {
+        // Read the records sequentially
+        std::vector<double> value(property_count);
+        for (size_t i = 0; i < count; i++){
+            for (size_t j = 0; j < property_count; j++){
+                const PlyProperty &property = element.property[j];
+                if (property.count_type != PlyNone){
+                    // Skip lists
+                    int items = cursor.Read(property.count_type);
+                    for (int k = 0; k < items; k++){
+                        cursor.Read(property.type);
+                    }
+                    value[j] = 0.0;
+                } else {
+                    value[j] = cursor.Read(property.type);
+                }
+            }
+            store_ply_vertex(layout, value.data(), first + i, data);
+        }
+    }
+}
+
+
+// Read the face element of a ply file
+static void parse_ply_faces(const PlyElement &element, int attributes, PlyCursor &cursor, PlyData &data){
+
+    // Find properties
+    int index_property = find_ply_property(element, "vertex_indices", "vertex_index");
+    int uv_property = find_ply_property(element, "texcoord");
+    if ((index_property < 0) || (element.property[index_property].count_type == PlyNone)){
+        throw(std::ios_base::failure(std::string("Error: ply face element needs a vertex_indices list")));
+    }
+    if ((uv_property >= 0) && ((element.property[uv_property].count_type == PlyNone) || (!(attributes & AttributeUV)))){
+        uv_property = -1;
+    }
+
+    // Read the faces sequentially, since their size varies
+    std::vector<int> index;
+    std::vector<UVType> uv;
+    for (size_t i = 0; i < element.count; i++){
+        index.clear();
+        uv.clear();
+        for (int j = 0; j < (int) element.property.size(); j++){
+            const PlyProperty &property = element.property[j];
+            if (property.count_type == PlyNone){
+                cursor.Read(property.type);
+                continue;
+            }
+            int items = cursor.Read(property.count_type);
+            if (j == index_property){
+                for (int k = 0; k < items; k++){
+                    index.push_back(cursor.Read(property.type));
+                }
+            } else if (j == uv_property){
+                for (int k = 0; k < items/2; k++){
+                    float u = cursor.Read(property.type);
+                    float v = cursor.Read(property.type);
+                    uv.push_back(UVType(u, v));
+                }
+                if (items % 2 == 1){
+                    cursor.Read(property.type);
+                }
+            } else {
+                for (int k = 0; k < items; k++){
+                    cursor.Read(property.type);
+                }
+            }
+        }
+        if (index.size() < 3){
+            throw(std::ios_base::failure(std::string("Error: faces need to have at least 3 vertices")));
+        }
+        // Break polygons into a fan of triangles
+        for (size_t k = 1; k + 1 < index.size(); k++){
+            data.index.push_back(index[0]);
+            data.index.push_back(index[k]);
+            data.index.push_back(index[k+1]);
+            if (uv_property >= 0){
+                // Faces without uvs keep a zero uv, so that the corner uvs
+                // stay aligned with the triangles
+                data.corner_uv.resize(data.index.size() - 3);
+                if (uv.size() == index.size()){
+                    data.corner_uv.push_back(uv[0]);
+                    data.corner_uv.push_back(uv[k]);
+                    data.corner_uv.push_back(uv[k+1]);
+                }
+                data.corner_uv.resize(data.index.size());
+            }
+        }
+    }
+}
+
+
+void parse_ply(const char *begin, const char *end, PlyData &data, int attributes){
+
+    // Parse header
+    PlyHeader header;
+    parse_ply_header(begin, end, header);
+
+    // Read elements in the order given by the header
+    PlyCursor cursor(begin + header.size, end, header.format);
+    for (unsigned int e = 0; e < header.element.size(); e++){
+        const PlyElement &element = header.element[e];
+        if (element.name == "vertex"){
+            parse_ply_vertices(element, header.format, attributes, cursor, data);
+        } else if (element.name == "face"){
+            parse_ply_faces(element, attributes, cursor, data);
+        } else {
+            // Skip other elements
+            size_t record_size = element.RecordSize();
+            if ((header.format != PlyAscii) && (record_size > 0)){
+                cursor.Skip(record_size*element.count);
+            } else {
+                for (size_t i = 0; i < element.count; i++){
+                    for (unsigned int j = 0; j < element.property.size(); j++){
+                        const PlyProperty &property = element.property[j];
+                        int items = 1;
+                        if (property.count_type != PlyNone){
+                            items = cursor.Read(property.count_type);
+                        }
+                        for (int k = 0; k < items; k++){
+                            cursor.Read(property.type);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void parse_stl(const char *begin, const char *end, StlData &data){
+
+    // A binary file has an 80-byte header, a triangle count, and 50 bytes
+    // per triangle. Ascii files start with "solid", but so do the headers
+    // of some binary files, so the size of the file decides the format
+    size_t size = end - begin;
+    unsigned int count = 0;
+    if (size >= 84){
+        memcpy(&count, begin + 80, sizeof(unsigned int));
+        if (!host_is_little_endian()){
+            char *b = (char *) &count;
+            std::reverse(b, b + sizeof(unsigned int));
+        }
+    }
+    bool binary = (size >= 84) && (84 + 50*((size_t) count) == size);
+    if ((!binary) && ((size < 5) || (memcmp(begin, "solid", 5) != 0))){
+        throw(std::ios_base::failure(std::string("Error: file is not a valid stl file")));
+    }
+
+    if (binary){
+        // Decode triangles in parallel, skipping the normal and the
+        // attribute of each record
+        data.position.resize(3*((size_t) count));
+        bool swap = !host_is_little_endian();
+        const char *records = begin + 84;
+        parallel_for(0, count, [&](size_t first, size_t last){
+            for (size_t i = first; i < last; i++){
+                const char *record = records + 50*i + 12;
+                for (int k = 0; k < 3; k++){
+                    PositionType &pos = data.position[3*i+k];
+                    for (int j = 0; j < 3; j++){
+                        pos[j] = ply_binary_value(record + 12*k + 4*j, PlyFloat32, swap);
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    // Read the vertex lines of the ascii format, ignoring the others
+    data.position.clear();
+    const char *p = begin;
+    while (p < end){
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (eol == NULL){
+            eol = end;
+        }
+        p = skip_blanks(p, eol);
+        const char *command_end = skip_token(p, eol);
+        if ((command_end - p == 6) && (memcmp(p, "vertex", 6) == 0)){
+            PositionType pos;
+            p = command_end;
+            for (int j = 0; j < 3; j++){
+                p = parse_float(skip_blanks(p, eol), eol, pos[j]);
+            }
+            data.position.push_back(pos);
+        }
+        p = eol + 1;
+    }
+    if (data.position.size() % 3 != 0){
+        throw(std::ios_base::failure(std::string("Error: stl facets need to have exactly 3 vertices")));
+    }
+}
+
+
+// Grid cell of a position and the index of the position, used to sort
+// positions so that coincident ones become adjacent
+struct WeldKey {
+    long long cell[3];
+    int index;
+};
+
+
+// Lexicographic order of weld keys. The index breaks ties, so that the
+// first position of each cell comes first
+static bool WeldKeyLess(const WeldKey &a, const WeldKey &b){
+
+    for (int j = 0; j < 3; j++){
+        if (a.cell[j] != b.cell[j]){
+            return a.cell[j] < b.cell[j];
+        }
+    }
+    return a.index < b.index;
+}
+
+
+void weld_positions(const std::vector<PositionType> &position, float epsilon, std::vector<int> &index, std::vector<PositionType> &unique){
+
+    // Compute the cell of each position in parallel
+    size_t count = position.size();
+    std::vector<WeldKey> key(count);
+    parallel_for(0, count, [&](size_t first, size_t last){
+        for (size_t i = first; i < last; i++){
+            key[i].index = i;
+            for (int j = 0; j < 3; j++){
+                float value = position[i][j];
+                if (epsilon > 0.0f){
+                    // Clamp cells to the range of the key
+                    double cell = std::floor(((double) value)/epsilon);
+                    cell = std::min(std::max(cell, -9.0e18), 9.0e18);
+                    key[i].cell[j] = (long long) cell;
+                } else {
+                    // Compare the bits of the value, with -0 equal to 0
+                    if (value == 0.0f){
+                        value = 0.0f;
+                    }
+                    int bits;
+                    memcpy(&bits, &value, sizeof(int));
+                    key[i].cell[j] = bits;
+                }
+            }
+        }
+    });
+
+    // Sort the keys, so that positions in the same cell are adjacent, and
+    // keep the first key of each cell
+    parallel_sort(key.begin(), key.end(), WeldKeyLess);
+    std::vector<WeldKey> cell_key;
+    std::vector<size_t> cell_start;
+    for (size_t i = 0; i < count; i++){
+        if ((i == 0) || (memcmp(key[i-1].cell, key[i].cell, sizeof(key[i].cell)) != 0)){
+            cell_key.push_back(key[i]);
+            cell_start.push_back(i);
+        }
+    }
+    size_t cell_count = cell_key.size();
+    cell_start.push_back(count);
+
+    // Merge positions with a union-find forest over the sorted keys, where
+    // the root of each tree is the earliest position
+    std::vector<int> root(count);
+    for (size_t i = 0; i < count; i++){
+        root[i] = i;
+    }
+    auto find_root = [&root](int i){
+        while (root[i] != i){
+            root[i] = root[root[i]];
+            i = root[i];
+        }
+        return i;
+    };
+    auto merge = [&](int a, int b){
+        a = find_root(a);
+        b = find_root(b);
+        if (key[a].index < key[b].index){
+            root[b] = a;
+        } else if (a != b){
+            root[a] = b;
+        }
+    };
+
+    if (epsilon > 0.0f){
+        // Positions within epsilon of each other are in the same or in
+        // neighboring cells. Each cell is compared with itself and with the
+        // 13 neighboring cells that follow it, and the pairs of positions
+        // within epsilon found by each block of cells are merged afterwards
+        int blocks = std::max<int>(std::min<size_t>(get_num_threads(), (cell_count + 4095)/4096), 1);
+        std::vector<std::vector<std::pair<int, int> > > pair(blocks);
+        parallel_invoke(blocks, [&](int block){
+            size_t begin = (cell_count*block)/blocks;
+            size_t end = (cell_count*(block+1))/blocks;
+            for (size_t c = begin; c < end; c++){
+                for (int dx = 0; dx <= 1; dx++){
+                    for (int dy = (dx == 0) ? 0 : -1; dy <= 1; dy++){
+                        for (int dz = ((dx == 0) && (dy == 0)) ? 0 : -1; dz <= 1; dz++){
+                            // Find the neighboring cell
+                            size_t n = c;
+                            if ((dx != 0) || (dy != 0) || (dz != 0)){
+                                WeldKey probe;
+                                probe.cell[0] = cell_key[c].cell[0] + dx;
+                                probe.cell[1] = cell_key[c].cell[1] + dy;
+                                probe.cell[2] = cell_key[c].cell[2] + dz;
+                                probe.index = -1;
+                                std::vector<WeldKey>::const_iterator it = std::lower_bound(cell_key.begin(), cell_key.end(), probe, WeldKeyLess);
+                                if ((it == cell_key.end()) || (memcmp(it->cell, probe.cell, sizeof(probe.cell)) != 0)){
+                                    continue;
+                                }
+                                n = it - cell_key.begin();
+                            }
+
+                            // Compare every position of the cell with every
+                            // position of the neighboring cell
+                            for (size_t i = cell_start[c]; i < cell_start[c+1]; i++){
+                                PositionType pos = position[key[i].index];
+                                for (size_t j = (n == c) ? i + 1 : cell_start[n]; j < cell_start[n+1]; j++){
+                                    PositionType diff = position[key[j].index] - pos;
+                                    if (diff[0]*diff[0] + diff[1]*diff[1] + diff[2]*diff[2] <= epsilon*epsilon){
+                                        pair[block].push_back(std::make_pair((int) i, (int) j));
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+        for (int block = 0; block < blocks; block++){
+            for (size_t k = 0; k < pair[block].size(); k++){
+                merge(pair[block][k].first, pair[block][k].second);
+            }
+        }
+    } else {
+        // Positions in the same cell are equal
+        for (size_t c = 0; c < cell_count; c++){
+            for (size_t i = cell_start[c] + 1; i < cell_start[c+1]; i++){
+                merge(cell_start[c], i);
+            }
+        }
+    }
+
+    // Link each position to the first position of its tree
+    std::vector<int> first(count);
+    for (size_t i = 0; i < count; i++){
+        first[key[i].index] = key[find_root(i)].index;
+    }
+
+    // Number the merged positions in order of first occurrence
+    index.resize(count);
+    unique.clear();
+    for (size_t i = 0; i < count; i++){
+        if (first[i] == (int) i){
+            index[i] = unique.size();
+            unique.push_back(position[i]);
+        } else {
+            index[i] = index[first[i]];
+        }
+    }
+}
+
+
+} // namespace GeomProc
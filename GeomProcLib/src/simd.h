@@ -0,0 +1,52 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+// SSE2 helpers shared by the translation units of the library. This header
+// is internal and is not installed with the public headers
+
+#include <cmath>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace GeomProc {
+
+#ifdef __SSE2__
+    // Mask of the lanes of x that are finite
+    inline __m128 finite_mask(__m128 x){
+
+        const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        return _mm_cmplt_ps(_mm_and_ps(x, abs_mask), _mm_set1_ps(INFINITY));
+    }
+
+    // Select a where mask is set and b elsewhere
+    inline __m128 select(__m128 mask, __m128 a, __m128 b){
+
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Clamp the lanes of x to [min, max]. NaN lanes become min
+    inline __m128 clamp(__m128 x, __m128 min, __m128 max){
+
+        return _mm_min_ps(_mm_max_ps(x, min), max);
+    }
+
+    // Smallest and largest of the four lanes of x
+    inline float horizontal_min(__m128 x){
+
+        x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+        x = _mm_min_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(x);
+    }
+
+    inline float horizontal_max(__m128 x){
+
+        x = _mm_max_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 0, 3, 2)));
+        x = _mm_max_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(x);
+    }
+#endif
+
+} // namespace GeomProc
+
+#endif // SIMD_H_
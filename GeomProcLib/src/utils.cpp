@@ -1,9 +1,34 @@
 #include <utils.h>
+#include "simd.h"
 #include <algorithm>
+#include <cmath>
+#include <atomic>
 
 namespace GeomProc {
 
 
+// Number of threads used by the parallel functions (0 = not set yet).
+// It can be set while other threads run parallel functions
+static std::atomic<int> thread_count(0);
+
+
+int get_num_threads(void){
+
+    int count = thread_count.load(std::memory_order_relaxed);
+    if (count <= 0){
+        int hw = std::thread::hardware_concurrency();
+        return (hw > 0) ? hw : 1;
+    }
+    return count;
+}
+
+
+void set_num_threads(int num_threads){
+
+    thread_count.store(num_threads, std::memory_order_relaxed);
+}
+
+
 glm::vec3 hsv2rgb(glm::vec3 in){
 
     double h, p, q, t, f;
@@ -147,34 +172,118 @@ float map_value(float val, float target_min, float target_max, float data_min, f
 
 void map_values(std::vector<float> &val, float target_min, float target_max, float data_min, float data_max){
 
+    map_values(val.data(), val.size(), target_min, target_max, data_min, data_max);
+}
+
+
+void map_values(float *val, size_t count, float target_min, float target_max, float data_min, float data_max){
+
     // Check if data min and max need to be computed
     if (data_min > data_max){
-        std::vector<float>::iterator min_it = std::min_element(val.begin(), val.end());
-        data_min = (*min_it);
-        std::vector<float>::iterator max_it = std::max_element(val.begin(), val.end());
-        data_max = (*max_it);
+        if (!parallel_finite_range(val, count, data_min, data_max)){
+            data_min = data_max = 0.0f;
+        }
     }
 
     // Pre-compute some constants
     float range = data_max - data_min;
     float new_range = target_max - target_min;
+    if (!(range > 0.0f)){
+        // Empty range, where every value maps to target_min
+        range = 1.0f;
+        new_range = 0.0f;
+    }
 
-    // Go through the vector mapping all values
-    std::vector<float>::iterator vit, vend;
-    vit = val.begin();
-    vend = val.end();
-    for (; vit != vend; vit++){
-        // Clamp value
-        if ((*vit) < data_min){
-            (*vit) = data_min;
+    // Go through the values in blocks mapping all values
+    parallel_for(0, count, [&](size_t begin, size_t end){
+        size_t i = begin;
+#ifdef __SSE2__
+        // The order of the operands of min and max keeps NaN values
+        __m128 vmin = _mm_set1_ps(data_min);
+        __m128 vmax = _mm_set1_ps(data_max);
+        __m128 vrange = _mm_set1_ps(range);
+        __m128 vtarget = _mm_set1_ps(target_min);
+        __m128 vnew_range = _mm_set1_ps(new_range);
+        for (; i + 4 <= end; i += 4){
+            __m128 x = _mm_min_ps(vmax, _mm_max_ps(vmin, _mm_loadu_ps(val + i)));
+            x = _mm_div_ps(_mm_sub_ps(x, vmin), vrange);
+            _mm_storeu_ps(val + i, _mm_add_ps(vtarget, _mm_mul_ps(x, vnew_range)));
         }
-        if ((*vit) > data_max){
-            (*vit) = data_max;
+#endif
+        for (; i < end; i++){
+            // Clamp value
+            float x = val[i];
+            if (x < data_min){
+                x = data_min;
+            }
+            if (x > data_max){
+                x = data_max;
+            }
+
+            // Map value
+            val[i] = target_min + ((x - data_min)/range)*new_range;
         }
+    }, 65536);
+}
+
+
+bool finite_range(const float *val, size_t count, float &min, float &max){
+
+    min = INFINITY;
+    max = -INFINITY;
+    size_t i = 0;
+#ifdef __SSE2__
+    // Infinite values are replaced by values that do not change the result
+    __m128 vmin = _mm_set1_ps(INFINITY);
+    __m128 vmax = _mm_set1_ps(-INFINITY);
+    for (; i + 4 <= count; i += 4){
+        __m128 x = _mm_loadu_ps(val + i);
+        __m128 finite = finite_mask(x);
+        vmin = _mm_min_ps(vmin, select(finite, x, _mm_set1_ps(INFINITY)));
+        vmax = _mm_max_ps(vmax, select(finite, x, _mm_set1_ps(-INFINITY)));
+    }
+    min = horizontal_min(vmin);
+    max = horizontal_max(vmax);
+#endif
+    for (; i < count; i++){
+        if (std::isfinite(val[i])){
+            min = std::min(min, val[i]);
+            max = std::max(max, val[i]);
+        }
+    }
+    return min <= max;
+}
+
+
+bool parallel_finite_range(const float *val, size_t count, float &min, float &max, size_t min_block){
+
+    size_t blocks = std::min<size_t>(get_num_threads(), (count + min_block - 1)/min_block);
+    if (blocks <= 1){
+        return finite_range(val, count, min, max);
+    }
+
+    // Range of each block, then of the whole array
+    std::vector<float> block_min(blocks);
+    std::vector<float> block_max(blocks);
+    parallel_invoke((int) blocks, [&](int b){
+        size_t begin = (count*b)/blocks;
+        size_t end = (count*(b+1))/blocks;
+        finite_range(val + begin, end - begin, block_min[b], block_max[b]);
+    });
+    min = *std::min_element(block_min.begin(), block_min.end());
+    max = *std::max_element(block_max.begin(), block_max.end());
+    return min <= max;
+}
+
+
+unsigned long long hash_bytes(const void *data, size_t size, unsigned long long hash){
 
-        // Map value
-        (*vit) = target_min + (((*vit) - data_min)/range)*new_range;
+    const unsigned char *byte = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++){
+        hash ^= byte[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
 }
 
 
@@ -3,8 +3,7 @@
 
 #include <mesh.h>
 #include <graph_dist.h>
-#include <utils.h>
-#include <algorithm>
+#include <color_map.h>
 #include <iostream>
 
 using namespace GeomProc;
@@ -32,24 +31,16 @@ int main(int argc, char *argv[]){
     gd.ComputeShortestPaths();
 
     // Transform distance field into vertex colors
-    // Find minimum and maximum distances (for mapping)
-    float min_dist = *std::min_element(gd.dist[0].begin(), gd.dist[0].end());
-    float max_dist = *std::max_element(gd.dist[0].begin(), gd.dist[0].end());
-    // Go through each vertex of the mesh
-    Mesh::VertexIterator vit, vend;
-    vit = mesh.VertexBegin();
-    vend = mesh.VertexEnd();
-    for (; vit != vend; vit++){
-        // Map distance to this vertex to a hue value between 0 and 0.75 (red to blue)
-        float h = map_value(max_dist - gd.dist[0][(*vit)->GetId()], 0, 0.75, min_dist, max_dist);
-        // Transform hue into an RGB color
-        glm::vec3 color = hsv2rgb(glm::vec3(h, 0.8, 0.8));
-        // Assign color to vertex
-        (*vit)->SetColor(color);
-    }
+    // Map the distances between their minimum and maximum to hue values
+    // between 0.75 and 0 (blue to red), as an array of colors indexed by
+    // vertex id
+    ColorMap color_map(0.75, 0.0, 0.8, 0.8);
+    std::vector<ColorType> colors;
+    color_map.Map(gd.dist[0], colors);
 
     // Write output mesh
     Mesh::WriteOptions options;
     options.write_vertex_colors = 1;
+    options.vertex_colors = colors.data();
     mesh.Write(argv[2], options);
 }
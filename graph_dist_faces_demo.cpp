@@ -3,8 +3,7 @@
 
 #include <mesh.h>
 #include <graph_dist.h>
-#include <utils.h>
-#include <algorithm>
+#include <color_map.h>
 #include <iostream>
 
 using namespace GeomProc;
@@ -33,29 +32,29 @@ int main(int argc, char *argv[]){
     gd.ComputeShortestPaths();
 
     // Transform distance field into vertex colors
-    // Find minimum and maximum distances (for mapping)
-    float min_dist = *std::min_element(gd.dist[0].begin(), gd.dist[0].end());
-    float max_dist = *std::max_element(gd.dist[0].begin(), gd.dist[0].end());
-    // Go through each face of the mesh
+    // Map the distances between their minimum and maximum to hue values
+    // between 0.75 and 0 (blue to red), as an array of colors indexed by
+    // face id
+    ColorMap color_map(0.75, 0.0, 0.8, 0.8);
+    std::vector<ColorType> face_colors;
+    color_map.Map(gd.dist[0], face_colors);
+    // Assign the color of each face to its vertices
+    std::vector<ColorType> colors(mesh.VertexCount());
     Mesh::FaceIterator fit, fend;
     fit = mesh.FaceBegin();
     fend = mesh.FaceEnd();
     for (; fit != fend; fit++){
-        // Map distance to this face to a hue value between 0 and 0.75 (red to blue)
-        float h = map_value(max_dist - gd.dist[0][(*fit)->GetId()], 0, 0.75, min_dist, max_dist);
-        // Transform hue into an RGB color
-        glm::vec3 color = hsv2rgb(glm::vec3(h, 0.8, 0.8));
-        // Assign color to vertices of the face
         Face::VertexIterator vit, vend;
         vit = (*fit)->VertexBegin();
         vend = (*fit)->VertexEnd();
         for (; vit != vend; vit++){
-            (*vit)->SetColor(color);
+            colors[(*vit)->GetId()] = face_colors[(*fit)->GetId()];
         }
     }
 
     // Write output mesh
     Mesh::WriteOptions options;
     options.write_vertex_colors = 1;
+    options.vertex_colors = colors.data();
     mesh.Write(argv[2], options);
 }